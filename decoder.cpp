@@ -7,17 +7,189 @@
 #include "psd.h"
 #include "psd_debug.h"
 #include "psd_details.h"
+#include "psd_downsample.h"
+#include "psd_interleaver.h"
+#include "psd_rle.h"
+#include "psd_row_reader.h"
+#include "psd_simd.h"
+#include "psd_thread_pool.h"
+#include "psd_zip.h"
 
 #include <cinttypes>
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 
 namespace psd {
 
+// Size of each block read from the FileInterface
+static constexpr size_t kBufferSize = 64*1024;
+
+// Maximum size of the decompressed scanlines of each block of rows
+// decoded in parallel
+static constexpr size_t kParallelBlockSize = 4*1024*1024;
+
+// Maximum memory used by each batch of layers decoded in parallel
+// (compressed channels and, if they must be recorded, scanlines)
+static constexpr uint64_t kParallelLayersBudget = 64*1024*1024;
+
+// Maximum size of each block of scanlines given to
+// DecoderDelegate::onImageRows()
+static constexpr size_t kImageRowsBlockSize = 256*1024;
+
+// Records the images decoded by a Decoder in a worker thread to give
+// them to the real delegate later from the main thread.
+class LayerImageRecorder : public DecoderDelegate {
+public:
+  void clear() {
+    m_images.clear();
+    m_rows.clear();
+    m_data.clear();
+  }
+
+  void onBeginImage(const ImageData& img) override {
+    m_images.push_back(Image{ img, m_rows.size() });
+  }
+
+  void onImageScanline(const ImageData& img,
+                       const int y,
+                       const ChannelID chanID,
+                       const uint8_t* data,
+                       const int bytes) override {
+    m_rows.push_back(Row{ y, chanID, m_data.size(), bytes });
+    m_data.insert(m_data.end(), data, data+bytes);
+  }
+
+  void replay(DecoderDelegate* delegate) const {
+    const bool rows = delegate->supportsImageRows();
+    for (size_t i=0; i<m_images.size(); ++i) {
+      const ImageData& img = m_images[i].img;
+      const size_t end = (i+1 < m_images.size() ? m_images[i+1].firstRow:
+                                                  m_rows.size());
+      delegate->onBeginImage(img);
+
+      // Buffers of the delegate to copy the rows directly
+      std::vector<uint8_t*> planes(img.channels.size(), nullptr);
+      std::vector<int> strides(img.channels.size(), 0);
+      if (!img.region.isEmpty()) {
+        for (size_t c=0; c<img.channels.size(); ++c)
+          planes[c] = delegate->channelPlane(img, img.channels[c], strides[c]);
+      }
+      const int top = img.region.top / img.scale;
+
+      for (size_t j=m_images[i].firstRow; j<end; ) {
+        const Row& row = m_rows[j];
+        const size_t c = std::find(img.channels.begin(),
+                                   img.channels.end(),
+                                   row.chanID) - img.channels.begin();
+        if (c < planes.size() && planes[c]) {
+          const uint8_t* src = m_data.data() + row.offset;
+          std::copy(src, src+row.bytes,
+                    planes[c] + size_t(row.y - top) * strides[c]);
+          ++j;
+          continue;
+        }
+
+        if (!rows) {
+          delegate->onImageScanline(img, row.y, row.chanID,
+                                    m_data.data() + row.offset, row.bytes);
+          ++j;
+          continue;
+        }
+
+        // Give consecutive rows of the same channel at once (they
+        // are contiguous in m_data)
+        const size_t maxRows =
+          std::max<size_t>(1, kImageRowsBlockSize / std::max(row.bytes, 1));
+        size_t k = j+1;
+        while (k < end && k-j < maxRows &&
+               m_rows[k].chanID == row.chanID &&
+               m_rows[k].y == row.y + int(k-j) &&
+               m_rows[k].bytes == row.bytes)
+          ++k;
+        delegate->onImageRows(img, row.y, int(k-j), row.chanID,
+                              m_data.data() + row.offset, row.bytes);
+        j = k;
+      }
+      delegate->onEndImage(img);
+    }
+  }
+
+private:
+  struct Image {
+    ImageData img;
+    size_t firstRow;
+  };
+  struct Row {
+    int y;
+    ChannelID chanID;
+    size_t offset;
+    int bytes;
+  };
+  std::vector<Image> m_images;
+  std::vector<Row> m_rows;
+  std::vector<uint8_t> m_data;
+};
+
+// Returns the number of bytes needed for "width" pixels of the given
+// depth (1-bit images have 8 pixels per byte)
+static size_t row_bytes(const int width, const int depth)
+{
+  return (depth == 1 ? (size_t(width)+7) / 8:
+                       size_t(width) * (depth/8));
+}
+
+// Returns true if we're running in a little-endian CPU
+static bool is_little_endian()
+{
+  const uint16_t value = 1;
+  return (*((const uint8_t*)&value) == 1);
+}
+
 Decoder::Decoder(FileInterface* file,
-                 DecoderDelegate* delegate)
-  : m_delegate(delegate)
+                 DecoderDelegate* delegate,
+                 const DecoderOptions& options)
+  : m_delegate(nullptr)
   , m_file(file)
+  , m_options(options)
+  , m_buffer(kBufferSize + (options.forwardOnly ? options.lookBehind: 0))
+  , m_bufferPos(options.forwardOnly ? 0: file->tell())
+  , m_bufferIdx(0)
+  , m_bufferLen(0)
+  , m_filePos(m_bufferPos)
+  , m_ok(true)
 {
+  switch (m_options.byteOrder) {
+    case ByteOrder::Native:       m_swapBytes = is_little_endian(); break;
+    case ByteOrder::BigEndian:    m_swapBytes = false; break;
+    case ByteOrder::LittleEndian: m_swapBytes = true; break;
+  }
+
+  int threads = m_options.threads;
+  if (threads == 0)
+    threads = int(std::thread::hardware_concurrency());
+  if (threads > 1)
+    m_threadPool.reset(new ThreadPool(threads));
+
+  if (m_options.pixelLayout != PixelLayout::Planar)
+    m_interleaver.reset(new Interleaver(m_options.pixelLayout, m_swapBytes));
+  setDelegate(delegate);
+}
+
+Decoder::~Decoder()
+{
+}
+
+// Sets the delegate to use, which receives the events through the
+// Interleaver if the pixels must be interleaved.
+void Decoder::setDelegate(DecoderDelegate* delegate)
+{
+  if (m_interleaver) {
+    m_interleaver->setDelegate(delegate);
+    m_delegate = (delegate ? m_interleaver.get(): nullptr);
+  }
+  else
+    m_delegate = delegate;
 }
 
 bool Decoder::readFileHeader()
@@ -101,7 +273,7 @@ bool Decoder::readColorModeData()
         "The color mode cannot be indexed/duotone and have size zero,"
         "this must be a corrupt file");
     else
-      return m_file->ok();
+      return ok();
   }
 
   if (m_header.colorMode == ColorMode::Indexed) {
@@ -119,24 +291,24 @@ bool Decoder::readColorModeData()
   else {
     // Read raw data
     data.data.resize(data.length);
-    m_file->read(&data.data[0], data.length);
+    readBytes(&data.data[0], data.length);
   }
 
   if (m_delegate)
     m_delegate->onColorModeData(data);
-  return m_file->ok();
+  return ok();
 }
 
 bool Decoder::readImageResources()
 {
   ImageResources res;
   uint32_t length = read32();
-  const uint32_t begin = m_file->tell();
-  const uint32_t end = begin + length;
+  const uint64_t begin = tell();
+  const uint64_t end = begin + length;
 
-  TRACE("All Image Resources Length=%d End=%d\n", length, end);
+  TRACE("All Image Resources Length=%d End=%" PRId64 "\n", length, end);
   while (length > 0) {
-    const uint32_t resBegin = m_file->tell();
+    const uint64_t resBegin = tell();
 
     const uint32_t magic = read32();
     if (magic != PSD_IMAGE_BLOCK_MAGIC_NUMBER)
@@ -151,12 +323,29 @@ bool Decoder::readImageResources()
 
     const std::string name = readPascalString(2);
     const uint32_t resLength = read32();
-    const size_t filePos = m_file->tell();
+    const uint64_t filePos = tell();
 
     ImageResource res;
     res.resourceID = resID;
     res.name = name;
-    if (resLength) {
+
+    // Thumbnails are read only once and the same bytes are used for
+    // the Thumbnail and the ImageResource data
+    if ((resID == 0x0409 || resID == 0x040C) && resLength) {
+      const uint8_t* data = fileView(filePos, resLength);
+      if (!data) {
+        res.data.resize(resLength);
+        readBytes(&res.data[0], resLength);
+      }
+      if (ok()) {
+        readThumbnail(resID, (data ? data: res.data.data()), resLength,
+                      data != nullptr);
+        if (data && m_delegate)
+          res.data.assign(data, data + resLength);
+      }
+    }
+    // Resources are only parsed to give them to the delegate
+    else if (resLength && m_delegate) {
       if (ImageResource::resIDHasDescriptor(resID)) {
         const uint32_t descVersion = read32();
         if (descVersion == 16)
@@ -178,23 +367,23 @@ bool Decoder::readImageResources()
         readResourceSlices();
       else {
         res.data.resize(resLength);
-        m_file->read(&res.data[0], resLength);
+        readBytes(&res.data[0], resLength);
       }
     }
 
-    m_file->seek(filePos+resLength);
+    seek(filePos+resLength);
     // Padded to make it even
     if (resLength & 1)
       read8();
 
-    const uint32_t resEnd = m_file->tell();
+    const uint64_t resEnd = tell();
 
     if (m_delegate)
       m_delegate->onImageResource(res);
 
-    length -= (resEnd - resBegin);
+    length -= uint32_t(resEnd - resBegin);
   }
-  m_file->seek(end);
+  seek(end);
 
   return (length == 0);
 }
@@ -573,7 +762,7 @@ uint64_t Decoder::readAdditionalLayerInfo(LayerRecord& layerRecord)
     dataLength = read32();
   }
 
-  const size_t fileBegin = m_file->tell();
+  const uint64_t fileBegin = tell();
   if (key == LayerInfoKey::lsct) {
     // Section divider setting (Photoshop 6.0)
     if (readSectionDivider(layerRecord, dataLength)) {
@@ -640,14 +829,14 @@ uint64_t Decoder::readAdditionalLayerInfo(LayerRecord& layerRecord)
       read8(); // this is supposed to be a kind of "duplicate" data???
       read16(); read8(); // 3 bytes padding
       const uint32_t metaDataLength = read32();
-      const size_t filePos = m_file->tell();
+      const uint64_t filePos = tell();
       if (metaKey == (uint32_t)LayerInfoKey::mlst)
         readLayerMLSTSection(layerRecord);
       else if (metaKey == (uint32_t)LayerInfoKey::cust)
         readLayerCUSTSection(layerRecord);
       else if (metaKey == (uint32_t)LayerInfoKey::tmln)
         readLayerTMLNSection(layerRecord);
-      m_file->seek(filePos + metaDataLength);
+      seek(filePos + metaDataLength);
     }
   }
 
@@ -663,7 +852,7 @@ uint64_t Decoder::readAdditionalLayerInfo(LayerRecord& layerRecord)
     dataLength, origLength);
   TRACE("\n");
 
-  m_file->seek(fileBegin + dataLength);
+  seek(fileBegin + dataLength);
   return dataLength;
 }
 
@@ -671,10 +860,19 @@ bool Decoder::readLayersAndMask()
 {
   LayersInformation layers;
   const uint64_t length = read32or64Length();
-  const uint64_t beg = m_file->tell();
+  const uint64_t beg = tell();
 
   TRACE("layers length=%" PRId64 "\n", length);
 
+  // Empty section (e.g. Bitmap images cannot have layers). It must
+  // not be parsed, in other case the image data that follows would
+  // be read as the layers info and the decoding would fail.
+  if (length == 0) {
+    if (m_delegate)
+      m_delegate->onLayersAndMask(layers);
+    return true;
+  }
+
   // Read layers info section
   readLayersInfo(layers);
 
@@ -682,12 +880,13 @@ bool Decoder::readLayersAndMask()
   readGlobalMaskInfo(layers);
 
   // Read tagged blocks with more data
-  if (m_file->tell() < beg+length) {
+  if (tell() < beg+length) {
     TRACE(" Tagged blocks\n");
 
     LayerRecord layerRecord;
-    while ((m_file->tell() - (beg+length)) > 4) {
-      readAdditionalLayerInfo(layerRecord);
+    while (tell()+4 < beg+length) {
+      if (readAdditionalLayerInfo(layerRecord) == 0)
+        break;
     }
 
     // TODO
@@ -696,7 +895,7 @@ bool Decoder::readLayersAndMask()
   if (m_delegate)
     m_delegate->onLayersAndMask(layers);
 
-  m_file->seek(beg + length);
+  seek(beg + length);
   return true;
 }
 
@@ -715,34 +914,46 @@ bool Decoder::readImageData()
   img.width = m_header.width;
   img.height = m_header.height;
   img.compressionMethod = data.compressionMethod;
+  img.region = imageRegion(0, 0, img.width, img.height);
+  img.scale = m_options.scale;
+  img.channels = imageDataChannels();
+
+  if (!m_options.metadataOnly)
+    readImage(img);
+  if (m_delegate)
+    m_delegate->onImageData(data);
+  return true;
+}
+
+// Returns the channels of the merged image data (in the order they
+// are stored in the file).
+std::vector<ChannelID> Decoder::imageDataChannels() const
+{
+  std::vector<ChannelID> channels;
   switch (m_header.nchannels) {
     case 1:
-      img.channels.push_back(ChannelID::Alpha);
+      channels.push_back(ChannelID::Alpha);
       break;
     case 2:
-      img.channels.push_back(ChannelID::TransparencyMask);
-      img.channels.push_back(ChannelID::Red);
+      channels.push_back(ChannelID::TransparencyMask);
+      channels.push_back(ChannelID::Red);
       break;
     case 3:
-      img.channels.push_back(ChannelID::Red);
-      img.channels.push_back(ChannelID::Green);
-      img.channels.push_back(ChannelID::Blue);
+      channels.push_back(ChannelID::Red);
+      channels.push_back(ChannelID::Green);
+      channels.push_back(ChannelID::Blue);
       break;
     case 4:
-      img.channels.push_back(ChannelID::Red);
-      img.channels.push_back(ChannelID::Green);
-      img.channels.push_back(ChannelID::Blue);
-      img.channels.push_back(ChannelID::Alpha);
+      channels.push_back(ChannelID::Red);
+      channels.push_back(ChannelID::Green);
+      channels.push_back(ChannelID::Blue);
+      channels.push_back(ChannelID::Alpha);
       break;
     default:
       throw std::runtime_error("Invalid number of channels"); // TODO support custom channels
       break;
   }
-
-  readImage(img);
-  if (m_delegate)
-    m_delegate->onImageData(data);
-  return true;
+  return channels;
 }
 
 bool Decoder::readLayersInfo(LayersInformation& layers)
@@ -759,7 +970,7 @@ bool Decoder::readLayersInfo(const uint64_t length, LayersInformation& layers)
   if (length == 0)
     return true;
 
-  uint64_t beg = m_file->tell();
+  uint64_t beg = tell();
   int16_t nlayers = read16();
 
   // If "nlayers" is negative the first alpha channel contains the
@@ -792,45 +1003,254 @@ bool Decoder::readLayersInfo(const uint64_t length, LayersInformation& layers)
     img.compressionMethod = CompressionMethod(compression);
     img.width = m_header.width;
     img.height = m_header.height;
+    img.region = imageRegion(0, 0, img.width, img.height);
+    img.scale = m_options.scale;
     img.channels.push_back(ChannelID::TransparencyMask);
     readImage(img);
   }
 
-  // Read channel data of each layer
-  uint32_t fileBegin = m_file->tell();
+  // Channel data of each layer is stored one after the other, so we
+  // can calculate where each channel starts
+  uint64_t fileBegin = tell();
   for (auto& layerRecord : layers.layers) {
-    if (m_delegate)
-      m_delegate->onBeginLayer(layerRecord);
-
     for (auto& channel : layerRecord.channels) {
-      const uint16_t compression = read16();
-      const int width = layerRecord.width();
-      const int height = layerRecord.height();
-      const uint32_t fileEnd = fileBegin + channel.length;
-
-      TRACE("Reading channel data for layer='%s' channel=%d compression:%d width=%d height=%d\n",
-            layerRecord.name.c_str(), channel.channelID,
-            compression, width, height);
-
-      ImageData img;
-      img.depth = m_header.depth;
-      img.compressionMethod = CompressionMethod(compression);
-      img.width = width;
-      img.height = height;
-      img.channels.push_back(channel.channelID);
-      readImage(img);
-
-      m_file->seek(fileEnd);
-      fileBegin = fileEnd;
+      channel.offset = fileBegin;
+      fileBegin += channel.length;
+    }
+  }
+
+  // Read channel data of each layer
+  if (m_threadPool && layers.layers.size() > 1 && !m_options.metadataOnly) {
+    readLayersImageParallel(layers.layers);
+  }
+  else {
+    std::vector<bool> channels;
+    for (auto& layerRecord : layers.layers) {
+      if (!m_options.metadataOnly)
+        getChannelsToDecode(layerRecord, channels);
+
+      if (m_delegate)
+        m_delegate->onBeginLayer(layerRecord);
+
+      if (!m_options.metadataOnly)
+        readLayerImage(layerRecord, channels);
+
+      if (m_delegate)
+        m_delegate->onEndLayer(layerRecord);
     }
-    if (m_delegate)
-      m_delegate->onEndLayer(layerRecord);
   }
 
-  m_file->seek(beg + length);
+  seek(beg + length);
   return true;
 }
 
+// Asks the delegate which channels of the given layer must be
+// decoded. Returns false if the whole layer can be skipped (also if
+// it's outside the region to decode).
+bool Decoder::getChannelsToDecode(const LayerRecord& layerRecord,
+                                  std::vector<bool>& channels)
+{
+  channels.assign(layerRecord.channels.size(), true);
+  if (!m_options.region.isEmpty() &&
+      imageRegion(layerRecord.left, layerRecord.top,
+                  layerRecord.width(), layerRecord.height()).isEmpty()) {
+    channels.assign(channels.size(), false);
+    return false;
+  }
+
+  if (!m_delegate)
+    return true;
+
+  if (!m_delegate->decodeLayer(layerRecord)) {
+    channels.assign(channels.size(), false);
+    return false;
+  }
+
+  bool result = false;
+  for (size_t i=0; i<channels.size(); ++i) {
+    channels[i] = m_delegate->decodeChannel(layerRecord,
+                                            layerRecord.channels[i]);
+    result |= channels[i];
+  }
+  return result;
+}
+
+// Reads the image data of the given channels of the layer from the
+// current position of the file (other channels are skipped).
+void Decoder::readLayerImage(const LayerRecord& layerRecord,
+                             const std::vector<bool>& channels)
+{
+  uint64_t fileBegin = tell();
+  for (size_t i=0; i<layerRecord.channels.size(); ++i) {
+    const Channel& channel = layerRecord.channels[i];
+    const uint64_t fileEnd = fileBegin + channel.length;
+
+    // Skip this channel
+    if (!channels[i]) {
+      seek(fileEnd);
+      fileBegin = fileEnd;
+      continue;
+    }
+
+    const uint16_t compression = read16();
+    const int width = layerRecord.width();
+    const int height = layerRecord.height();
+
+    TRACE("Reading channel data for layer='%s' channel=%d compression:%d width=%d height=%d\n",
+          layerRecord.name.c_str(), channel.channelID,
+          compression, width, height);
+
+    ImageData img;
+    img.depth = m_header.depth;
+    img.compressionMethod = CompressionMethod(compression);
+    img.width = width;
+    img.height = height;
+    img.region = imageRegion(layerRecord.left, layerRecord.top,
+                             width, height);
+    img.scale = m_options.scale;
+    img.channels.push_back(channel.channelID);
+    readImage(img);
+
+    seek(fileEnd);
+    fileBegin = fileEnd;
+  }
+}
+
+// Decodes several layers at the same time in the thread pool. Each
+// layer is decoded by a Decoder that reads the layer channels from
+// memory (a view of the file, or a copy of the channels data read
+// with FileInterface::readAt() from the worker thread if possible). If the
+// delegate is not thread-safe, the decoded scanlines are recorded
+// and then given to the delegate layer by layer from this thread.
+void Decoder::readLayersImageParallel(const std::vector<LayerRecord>& layers)
+{
+  const bool record = (m_delegate && !m_delegate->isThreadSafe());
+  const size_t maxLayers = 4 * size_t(m_threadPool->threads());
+
+  DecoderOptions options = m_options;
+  options.threads = 1;
+  options.forwardOnly = false;
+  options.pixelLayout = PixelLayout::Planar;
+
+  std::vector<uint64_t> offsets(maxLayers);
+  std::vector<uint64_t> sizes(maxLayers);
+  std::vector<const uint8_t*> data(maxLayers);
+  std::vector<std::vector<uint8_t>> buffers(maxLayers);
+  std::vector<LayerImageRecorder> recorders(record ? maxLayers: 0);
+
+  // The delegate is asked for all layers before decoding them
+  std::vector<std::vector<bool>> channels(layers.size());
+  std::vector<bool> decodeLayer(layers.size());
+  for (size_t i=0; i<layers.size(); ++i)
+    decodeLayer[i] = getChannelsToDecode(layers[i], channels[i]);
+
+  uint64_t pos = tell();
+  size_t i = 0;
+  while (i < layers.size()) {
+    // Select the layers of this batch, limiting the used memory
+    size_t n = 0;
+    uint64_t memory = 0;
+    while (i+n < layers.size() && n < maxLayers) {
+      const LayerRecord& layerRecord = layers[i+n];
+      uint64_t size = 0;
+      uint64_t layerMemory = 0;
+      for (size_t j=0; j<layerRecord.channels.size(); ++j) {
+        size += layerRecord.channels[j].length;
+        if (record && channels[i+n][j])
+          layerMemory += uint64_t(layerRecord.height())
+            * (m_header.depth == 1 ? (layerRecord.width()+7) / 8:
+                                     layerRecord.width() * (m_header.depth/8));
+      }
+      if (decodeLayer[i+n])
+        layerMemory += size;
+      if (n > 0 && memory + layerMemory > kParallelLayersBudget)
+        break;
+      sizes[n++] = size;
+      memory += layerMemory;
+    }
+
+    // Just one big layer, decode it in this thread (its rows can
+    // still be decoded in parallel)
+    if (n == 1) {
+      const LayerRecord& layerRecord = layers[i];
+      seek(pos);
+      if (m_delegate)
+        m_delegate->onBeginLayer(layerRecord);
+      readLayerImage(layerRecord, channels[i]);
+      if (m_delegate)
+        m_delegate->onEndLayer(layerRecord);
+      pos += sizes[0];
+      ++i;
+      continue;
+    }
+
+    // Get the channels data of each layer. If the file supports
+    // positional reads, each worker reads its own layer.
+    const bool readAt = (m_file->canReadAt() && !m_options.forwardOnly);
+    for (size_t k=0; k<n; ++k) {
+      offsets[k] = pos;
+      data[k] = (decodeLayer[i+k] ? fileView(pos, sizes[k]): nullptr);
+      if (decodeLayer[i+k] && !data[k] && !readAt) {
+        seek(pos);
+        buffers[k].resize(sizes[k]);
+        readBytes(buffers[k].data(), sizes[k]);
+        if (!ok())
+          throw std::runtime_error("end-of-file not expected");
+        data[k] = buffers[k].data();
+      }
+      pos += sizes[k];
+    }
+    seek(pos);
+
+    m_threadPool->parallelFor(
+      n, [&](size_t k){
+        const LayerRecord& layerRecord = layers[i+k];
+        DecoderDelegate* delegate = m_delegate;
+        if (!decodeLayer[i+k]) {
+          if (delegate && !record) {
+            delegate->onBeginLayer(layerRecord);
+            delegate->onEndLayer(layerRecord);
+          }
+          return;
+        }
+
+        if (!data[k]) {
+          buffers[k].resize(sizes[k]);
+          if (m_file->readAt(offsets[k], buffers[k].data(), sizes[k]) != sizes[k])
+            throw std::runtime_error("end-of-file not expected");
+          data[k] = buffers[k].data();
+        }
+
+        if (record) {
+          recorders[k].clear();
+          delegate = &recorders[k];
+        }
+
+        MemoryFileInterface file(data[k], sizes[k]);
+        Decoder decoder(&file, delegate, options);
+        decoder.m_header = m_header;
+
+        if (delegate && !record)
+          delegate->onBeginLayer(layerRecord);
+        decoder.readLayerImage(layerRecord, channels[i+k]);
+        if (delegate && !record)
+          delegate->onEndLayer(layerRecord);
+      });
+
+    if (record) {
+      for (size_t k=0; k<n; ++k) {
+        const LayerRecord& layerRecord = layers[i+k];
+        m_delegate->onBeginLayer(layerRecord);
+        if (decodeLayer[i+k])
+          recorders[k].replay(m_delegate);
+        m_delegate->onEndLayer(layerRecord);
+      }
+    }
+
+    i += n;
+  }
+}
+
 bool Decoder::readLayerRecord(LayersInformation& layers,
                               LayerRecord& layerRecord)
 {
@@ -873,15 +1293,15 @@ bool Decoder::readLayerRecord(LayersInformation& layers,
   read8();                      // filler (zero)
 
   const uint32_t length = read32();
-  const uint32_t beforeDataPos = m_file->tell();
+  const uint64_t beforeDataPos = tell();
 
   // Read mask data
   uint32_t maskLength = read32();
-  m_file->seek(m_file->tell() + maskLength);
+  skip(maskLength);
 
   // Read blending ranges
   uint32_t blendingRangesLength = read32();
-  m_file->seek(m_file->tell() + blendingRangesLength);
+  skip(blendingRangesLength);
 
   // Read layer name
   layerRecord.name = readPascalString(4);
@@ -895,18 +1315,18 @@ bool Decoder::readLayerRecord(LayersInformation& layers,
          nchannels,
          layerRecord.name.c_str());
 
-  const size_t expectedPos = beforeDataPos + length;
-  while (m_file->tell() < expectedPos) {
+  const uint64_t expectedPos = beforeDataPos + length;
+  while (tell() < expectedPos) {
     if (readAdditionalLayerInfo(layerRecord) == 0)
       break;
   }
-  m_file->seek(expectedPos);
+  seek(expectedPos);
   return true;
 }
 
 bool Decoder::readGlobalMaskInfo(LayersInformation& layers)
 {
-  const std::size_t filePos = m_file->tell();
+  const uint64_t filePos = tell();
   uint64_t length = read32();
   TRACE("Global mask info length=%" PRId64 "\n", length);
   if (length == 0)
@@ -927,56 +1347,51 @@ bool Decoder::readGlobalMaskInfo(LayersInformation& layers)
   layers.maskInfo.kind =
     static_cast<GlobalMaskInfo::MaskKind>(maskKind);
 
-  m_file->seek(filePos + length);
+  seek(filePos + length);
   return true;
 }
 
 uint16_t Decoder::read16()
 {
-  int b1 = read8();
-  int b2 = read8();
-
-  if (m_file->ok()) {
-    return ((b1 << 8) | b2); // Big endian
-  }
-  else
+  if (m_bufferLen - m_bufferIdx < 2 && !fillBuffer(2))
     return 0;
+
+  const uint8_t* p = &m_buffer[m_bufferIdx];
+  m_bufferIdx += 2;
+  return ((p[0] << 8) | p[1]); // Big endian
 }
 
 uint32_t Decoder::read32()
 {
-  int b1 = read8();
-  int b2 = read8();
-  int b3 = read8();
-  int b4 = read8();
-
-  if (m_file->ok()) {
-    // Big endian
-    return ((b1 << 24) | (b2 << 16) | (b3 << 8) | b4);
-  }
-  else
+  if (m_bufferLen - m_bufferIdx < 4 && !fillBuffer(4))
     return 0;
+
+  const uint8_t* p = &m_buffer[m_bufferIdx];
+  m_bufferIdx += 4;
+  // Big endian
+  return ((uint32_t(p[0]) << 24) |
+          (uint32_t(p[1]) << 16) |
+          (uint32_t(p[2]) << 8) |
+          uint32_t(p[3]));
 }
 
 uint64_t Decoder::read64()
 {
-  uint8_t bytes[8];
-  m_file->read(bytes, 8);
-
-  if (m_file->ok()) {
-    // Big endian
-    return uint64_t(
-      (uint64_t(bytes[0]) << 56) |
-      (uint64_t(bytes[1]) << 48) |
-      (uint64_t(bytes[2]) << 40) |
-      (uint64_t(bytes[3]) << 32) |
-      (uint64_t(bytes[4]) << 24) |
-      (uint64_t(bytes[5]) << 16) |
-      (uint64_t(bytes[6]) << 8) |
-      uint64_t(bytes[7]));
-  }
-  else
+  if (m_bufferLen - m_bufferIdx < 8 && !fillBuffer(8))
     return 0;
+
+  const uint8_t* p = &m_buffer[m_bufferIdx];
+  m_bufferIdx += 8;
+  // Big endian
+  return uint64_t(
+    (uint64_t(p[0]) << 56) |
+    (uint64_t(p[1]) << 48) |
+    (uint64_t(p[2]) << 40) |
+    (uint64_t(p[3]) << 32) |
+    (uint64_t(p[4]) << 24) |
+    (uint64_t(p[5]) << 16) |
+    (uint64_t(p[6]) << 8) |
+    uint64_t(p[7]));
 }
 
 uint32_t Decoder::read16or32Length()
@@ -1019,21 +1434,269 @@ std::string Decoder::readPascalString(const int alignment)
   return result;
 }
 
-bool Decoder::readImage(const ImageData& img)
+void Decoder::seek(const uint64_t absPos)
+{
+  // Inside the buffered block
+  if (absPos >= m_bufferPos &&
+      absPos <= m_bufferPos + m_bufferLen) {
+    m_bufferIdx = size_t(absPos - m_bufferPos);
+  }
+  // We cannot go back before the look-behind bytes of the buffer
+  else if (m_options.forwardOnly && absPos < m_bufferPos) {
+    throw std::runtime_error("cannot seek backward in forward-only mode");
+  }
+  // Discard the buffer, the FileInterface is moved to the new
+  // position in the next fillBuffer()
+  else {
+    m_bufferPos = absPos;
+    m_bufferIdx = 0;
+    m_bufferLen = 0;
+  }
+}
+
+// Makes sure that there are at least "n" bytes (n <= kBufferSize)
+// available in the buffer to be read. Returns false (and ok() will
+// be false too) if we've reached the end of the file.
+bool Decoder::fillBuffer(const size_t n)
+{
+  // Move the pending bytes to the beginning of the buffer (in
+  // forward-only mode the last read bytes are kept before them)
+  const size_t keep =
+    (m_options.forwardOnly ? std::min(m_bufferIdx, m_options.lookBehind): 0);
+  const size_t discard = m_bufferIdx - keep;
+  const size_t pending = m_bufferLen - m_bufferIdx;
+  if (discard > 0 && keep + pending > 0)
+    std::memmove(&m_buffer[0], &m_buffer[discard], keep + pending);
+  m_bufferPos += discard;
+  m_bufferIdx = keep;
+  m_bufferLen = keep + pending;
+
+  const uint64_t end = m_bufferPos + m_bufferLen;
+  if (m_filePos != end)
+    seekFile(end);
+
+  // Streams can return less bytes than requested before the end of
+  // the file, so we read until we have the "n" required bytes
+  while (m_bufferLen - m_bufferIdx < n) {
+    const size_t bytes =
+      m_file->readSome(&m_buffer[m_bufferLen],
+                       m_buffer.size() - m_bufferLen);
+    if (bytes == 0)
+      break;
+    m_filePos += bytes;
+    m_bufferLen += bytes;
+  }
+
+  if (m_bufferLen - m_bufferIdx < n) {
+    m_ok = false;
+    return false;
+  }
+  return true;
+}
+
+// Moves the FileInterface to the given position. In forward-only
+// mode the bytes until that position are read and discarded.
+void Decoder::seekFile(const uint64_t pos)
+{
+  if (!m_options.forwardOnly) {
+    m_file->seek(pos);
+    m_filePos = pos;
+    return;
+  }
+
+  if (pos < m_filePos)
+    throw std::runtime_error("cannot seek backward in forward-only mode");
+
+  std::vector<uint8_t> discarded(size_t(std::min<uint64_t>(pos - m_filePos,
+                                                           kBufferSize)));
+  while (m_filePos < pos) {
+    const size_t bytes =
+      m_file->readSome(discarded.data(),
+                       size_t(std::min<uint64_t>(pos - m_filePos,
+                                                 discarded.size())));
+    if (bytes == 0)
+      break;
+    m_filePos += bytes;
+  }
+
+  // End of file, next reads will fail
+  m_filePos = pos;
+}
+
+// Returns FileInterface::view() (which is not used in forward-only
+// mode because the positions of the stream can be different).
+const uint8_t* Decoder::fileView(const uint64_t pos, const size_t n)
+{
+  return (m_options.forwardOnly ? nullptr: m_file->view(pos, n));
+}
+
+void Decoder::readBytes(uint8_t* buf, const size_t n)
+{
+  size_t pending = m_bufferLen - m_bufferIdx;
+  if (n <= pending) {
+    std::memcpy(buf, &m_buffer[m_bufferIdx], n);
+    m_bufferIdx += n;
+    return;
+  }
+
+  // In forward-only mode the data goes through the buffer to keep
+  // the look-behind bytes
+  if (m_options.forwardOnly) {
+    size_t i = 0;
+    while (i < n) {
+      if (m_bufferIdx == m_bufferLen && !fillBuffer(1))
+        return;
+
+      const size_t k = std::min(n - i, m_bufferLen - m_bufferIdx);
+      std::memcpy(buf + i, &m_buffer[m_bufferIdx], k);
+      m_bufferIdx += k;
+      i += k;
+    }
+    return;
+  }
+
+  // Copy the buffered part and read the rest directly from the file
+  if (pending > 0)
+    std::memcpy(buf, &m_buffer[m_bufferIdx], pending);
+
+  const uint64_t pos = tell() + pending;
+  if (m_filePos != pos)
+    seekFile(pos);
+
+  size_t bytes = 0;
+  while (pending + bytes < n) {
+    const size_t k = m_file->readSome(buf + pending + bytes,
+                                      n - pending - bytes);
+    if (k == 0)
+      break;
+    bytes += k;
+  }
+  m_filePos = pos + bytes;
+  m_bufferPos = m_filePos;
+  m_bufferIdx = 0;
+  m_bufferLen = 0;
+
+  if (pending + bytes < n)
+    m_ok = false;
+}
+
+// Reads "n" bytes at the absolute position "pos" without filling the
+// buffer, to read a few bytes far from each other (e.g. the
+// compression method of each channel) without reading a whole
+// block for each one.
+void Decoder::readBytesAt(const uint64_t pos, uint8_t* buf, const size_t n)
+{
+  if (!m_options.forwardOnly && m_file->canReadAt()) {
+    size_t bytes = 0;
+    while (bytes < n) {
+      const size_t k = m_file->readAt(pos + bytes, buf + bytes, n - bytes);
+      if (k == 0)
+        break;
+      bytes += k;
+    }
+    if (bytes < n)
+      m_ok = false;
+    return;
+  }
+
+  // readBytes() reads directly from the file what is not buffered
+  seek(pos);
+  readBytes(buf, n);
+}
+
+// Returns a pointer to the next "n" bytes of the file and moves the
+// file position after them. If the bytes are already buffered or the
+// FileInterface supports view(), the bytes are not copied, in other
+// case they are read into the given buffer (which can be reused
+// between calls). The returned pointer is valid until the next read.
+const uint8_t* Decoder::readView(const size_t n, std::vector<uint8_t>& buffer)
 {
-  int scanlineSize =
-    (img.depth >= 8 ?
-     (img.width * (img.depth/8)):
-     (img.width / img.depth + (img.width % img.depth ? 1: 0)));
+  if (n <= m_bufferLen - m_bufferIdx) {
+    const uint8_t* ptr = &m_buffer[m_bufferIdx];
+    m_bufferIdx += n;
+    return ptr;
+  }
+
+  const uint64_t pos = tell();
+  if (const uint8_t* ptr = fileView(pos, n)) {
+    seek(pos + n);
+    return ptr;
+  }
+
+  if (buffer.size() < n)
+    buffer.resize(n);
+  if (n > 0)
+    readBytes(&buffer[0], n);
+  return buffer.data();
+}
+
+// Decompresses the next "n" bytes of the image data (a scanline) in
+// "row". The compressed data is consumed directly from the buffered
+// block of the file.
+void Decoder::inflateRow(Inflater& inflater, uint8_t* row, size_t n)
+{
+  while (n > 0) {
+    if (m_bufferIdx == m_bufferLen && !fillBuffer(1))
+      break;
 
-  if (scanlineSize & 1)
-    ++scanlineSize;
+    const uint8_t* in = &m_buffer[m_bufferIdx];
+    size_t inSize = m_bufferLen - m_bufferIdx;
+    const bool more = inflater.inflate(in, inSize, row, n);
+    m_bufferIdx = m_bufferLen - inSize;
+    if (!more)
+      break;
+  }
 
-  std::vector<uint8_t> scanline(scanlineSize);
+  // Truncated data (the end of the file or of the ZIP stream was
+  // reached before the end of the scanline)
+  if (n > 0)
+    throw std::runtime_error("end-of-file not expected");
+}
+
+RowReader::RowReader(const ImageData& img, const bool swapBytes)
+  : img(img)
+  , swapBytes(swapBytes)
+{
+  const Region& region = img.region;
+  rowBytes = row_bytes(img.width, img.depth);
+  firstByte = row_bytes(region.left, img.depth);
+  lastByte = row_bytes(region.right, img.depth);
+  regionBytes = lastByte - firstByte;
+  outWidth = (region.width() + img.scale - 1) / img.scale;
+  outBytes = row_bytes(outWidth, img.depth);
+
+  scanline.resize(rowBytes);
+  if (img.scale > 1)
+    scaled.resize(outBytes);
+
+  if (img.compressionMethod == CompressionMethod::ZIPWithoutPrediction ||
+      img.compressionMethod == CompressionMethod::ZIPWithPrediction)
+    inflater.reset(new Inflater);
+}
+
+bool Decoder::readImage(const ImageData& img)
+{
+  switch (img.compressionMethod) {
+    case CompressionMethod::RawImageData:
+    case CompressionMethod::RLE:
+    case CompressionMethod::ZIPWithoutPrediction:
+    case CompressionMethod::ZIPWithPrediction:
+      break;
+    default:
+      throw std::runtime_error("Unknown compression method");
+  }
 
   if (m_delegate)
     m_delegate->onBeginImage(img);
 
+  // Nothing to decode
+  const Region& region = img.region;
+  if (region.isEmpty()) {
+    if (m_delegate)
+      m_delegate->onEndImage(img);
+    return true;
+  }
+
   std::vector<uint32_t> byteCounts;
   if (img.compressionMethod == CompressionMethod::RLE) {
     byteCounts.resize(img.height * img.channels.size());
@@ -1041,151 +1704,373 @@ bool Decoder::readImage(const ImageData& img)
       byteCounts[i] = read16or32Length();
   }
 
+  // Samples are stored in big-endian
+  const bool swapBytes = (img.depth >= 16 && m_swapBytes);
+
+  if (img.compressionMethod == CompressionMethod::RLE && m_threadPool) {
+    readRLEParallel(img, byteCounts, swapBytes);
+
+    if (m_delegate)
+      m_delegate->onEndImage(img);
+    return true;
+  }
+
+  RowReader reader(img, swapBytes);
+
+  // Rows are accumulated in blocks if the delegate supports
+  // onImageRows() and several rows fit in one block
+  const size_t outBytes = reader.outBytes;
+  const size_t blockRows =
+    (m_delegate && m_delegate->supportsImageRows() ?
+     kImageRowsBlockSize / std::max<size_t>(outBytes, 1): 0);
+  std::vector<uint8_t> block(blockRows > 1 ? blockRows * outBytes: 0);
+  int blockY = 0;
+  int nrows = 0;
+
   // Read channel by channel
   int curByteCount = 0;
-  for (ChannelID chanID : img.channels) {
+  for (size_t c=0; c<img.channels.size(); ++c) {
+    const ChannelID chanID = img.channels[c];
+
     TRACE("--- Channel ID=%d compression=%d depth=%d scanline=%zu ---\n",
           chanID,
           img.compressionMethod,
           img.depth,
-          scanline.size());
-
-    switch (img.compressionMethod) {
-
-      case CompressionMethod::RawImageData:
-        for (int y=0; y<img.height; ++y) {
-
-          std::vector<uint8_t> rawData;
-          rawData.reserve(img.width * (img.depth == 1 ? 1: img.depth/8));
-
-          for (int x=0; x<img.width; ) {
-            if (img.depth == 1) {
-              uint8_t byte = read8();
-              TRACE("%d %d%d%d%d%d%d%d%d",
-                    byte,
-                    (byte & 0x80) >> 7,
-                    (byte & 0x40) >> 6,
-                    (byte & 0x20) >> 5,
-                    (byte & 0x10) >> 4,
-                    (byte & 0x08) >> 3,
-                    (byte & 0x04) >> 2,
-                    (byte & 0x02) >> 1,
-                    (byte & 0x01));
-              x += 8;
-              rawData.push_back(byte);
-            }
-            else if (img.depth == 8) {
-              uint8_t byte = read8();
-              TRACE(" %02x", byte);
-              ++x;
-              rawData.push_back(byte);
-            }
-            else if (img.depth == 16) {
-              uint16_t word = read16();
-              TRACE(" %04x", word);
-              ++x;
-              rawData.push_back(word & 0xff);
-              rawData.push_back(word >> 8);
-            }
-            else if (img.depth == 32) {
-              uint32_t dword = read32();
-              TRACE(" %08x", dword);
-              ++x;
-              rawData.push_back(dword >> 24);
-              rawData.push_back(dword >> 16);
-              rawData.push_back(dword >> 8);
-              rawData.push_back(dword);
-            }
-            else {
-              throw std::runtime_error(
-                "Unsupported raw image depth");
-            }
-          }
-          TRACE("\n");
+          reader.rowBytes);
+
+    // Rows after the region of the last channel are not needed
+    const int lastRow = (c+1 < img.channels.size() ? img.height:
+                                                      region.bottom);
+
+    // Buffer to decode the rows directly
+    int stride = 0;
+    uint8_t* plane =
+      (m_delegate ? m_delegate->channelPlane(img, chanID, stride): nullptr);
+
+    for (int y=0; y<lastRow; ++y, ++curByteCount) {
+      const bool inside = reader.isInside(y);
+      uint8_t* dst = nullptr;
+      if (plane && inside)
+        dst = plane + size_t((y - region.top) / img.scale) * stride;
+
+      const uint8_t* row =
+        readRow(reader, inside,
+                byteCounts.empty() ? 0: byteCounts[curByteCount],
+                dst);
+
+      if (!row || !m_delegate || plane)
+        continue;
+
+      if (block.empty()) {
+        if (blockRows > 0)
+          m_delegate->onImageRows(
+            img, y / img.scale, 1, chanID,
+            row, int(outBytes));
+        else
+          m_delegate->onImageScanline(
+            img, y / img.scale, chanID,
+            row, int(outBytes));
+        continue;
+      }
 
-          if (m_delegate)
-            m_delegate->onImageScanline(
-              img, y, chanID,
-              &rawData[0], rawData.size());
-        }
-        break;
+      if (nrows == 0)
+        blockY = y / img.scale;
+      std::copy(row, row+outBytes, block.begin() + nrows*outBytes);
+      if (++nrows == int(blockRows)) {
+        m_delegate->onImageRows(img, blockY, nrows, chanID,
+                                block.data(), int(outBytes));
+        nrows = 0;
+      }
+    }
 
-      case CompressionMethod::RLE:
-        switch (m_header.depth) {
-
-          case 8: {
-            auto end = scanline.end();
-            for (int y=0; y<img.height; ++y, ++curByteCount) {
-              auto it = scanline.begin();
-
-              int32_t remaining = byteCounts[curByteCount];
-              TRACE("   line[%d] (remaining=%d): ", y, remaining);
-              while (remaining > 0) {
-                int8_t n = int8_t(m_file->read8());
-                TRACE("n=%d ", n);
-                --remaining;
-
-                if (n == -128) {
-                  // No operation, skip this byte
-                }
-                else if (n >= 0 && n <= 127) {
-                  for (int j=0; j<int(n)+1; ++j, ++it) {
-                    if (it == end)
-                      break; // throw std::runtime_error("invalid RLE data (too much individual values)");
-                    *it = read8();
-                  }
-                  remaining -= int(n)+1;
-                }
-                else if (n < 0) {
-                  uint8_t data = read8();
-                  // TRACE("Repeat %d value %d times\n",
-                  //       data, 1-int(n));
-                  --remaining;
-                  for (int j=1-int(n); j>0; --j, ++it) {
-                    // TRACE("  %d ", j);
-                    if (it == end)
-                      break; // throw std::runtime_error("invalid RLE data (too much repeated values)");
-                    *it = data;
-                  }
-                }
-              }
-              TRACE("\n");
-
-              if (!m_file->ok())
-                throw std::runtime_error("end-of-file not expected");
-
-              // if (it < end)
-              //   throw std::runtime_error("invalid RLE data (count too small)");
-
-              for (; it < end; ++it)
-                *it = 0;
-
-              if (m_delegate) {
-                m_delegate->onImageScanline(
-                  img, y, chanID,
-                  &scanline[0], scanline.size());
-              }
-            }
-            break;
-          }
+    if (nrows > 0) {
+      m_delegate->onImageRows(img, blockY, nrows, chanID,
+                              block.data(), int(outBytes));
+      nrows = 0;
+    }
+  }
 
+  if (m_delegate)
+    m_delegate->onEndImage(img);
+
+  return true;
+}
+
+// Reads the next scanline of the image from the current position of
+// the file ("compressedBytes" is its size in the RLE byte counts
+// table). Returns the decoded scanline (downsampled and in the
+// requested byte order), or nullptr if the row is not "inside" (in
+// that case it's skipped without decompressing it if possible). If
+// "dst" is specified the scanline is decoded there (directly if
+// possible), in other case the returned pointer is valid until the
+// next read.
+const uint8_t* Decoder::readRow(RowReader& reader,
+                                const bool inside,
+                                const uint32_t compressedBytes,
+                                uint8_t* dst)
+{
+  const ImageData& img = reader.img;
+
+  // Scanlines are decompressed in "dst" when the result doesn't
+  // need to be cropped or downsampled
+  const bool direct = (dst && inside && img.scale == 1 &&
+                       reader.firstByte == 0);
+  uint8_t* scanline = reader.scanline.data();
+  const uint8_t* row = scanline + reader.firstByte;
+
+  switch (img.compressionMethod) {
+
+    // Read the region of the scanline at once (without copying it
+    // if the FileInterface supports view(), or directly in "dst")
+    case CompressionMethod::RawImageData:
+      if (inside) {
+        skip(reader.firstByte);
+        if (dst && img.scale == 1) {
+          readBytes(dst, reader.regionBytes);
+          row = dst;
         }
-        break;
+        else
+          row = readView(reader.regionBytes, reader.buffer);
+        skip(reader.rowBytes - reader.lastByte);
+      }
+      else
+        skip(reader.rowBytes);
+      break;
 
-      case CompressionMethod::ZIPWithoutPrediction:
-        // TODO
+    // PackBits compression works with bytes, so it's the same for
+    // all depths (1-bit scanlines have 8 pixels per byte).
+    case CompressionMethod::RLE: {
+      if (!inside) {
+        skip(compressedBytes);
         break;
+      }
 
-      case CompressionMethod::ZIPWithPrediction:
-        // TODO
+      // Read the whole compressed scanline at once
+      const uint8_t* compressedData = readView(compressedBytes,
+                                               reader.buffer);
+      if (!ok())
         break;
+
+      // Runs after the right edge of the region are not expanded
+      if (direct)
+        scanline = dst;
+      const size_t n = unpack_bits(compressedData, compressedBytes,
+                                   scanline, reader.lastByte);
+      TRACE("   line (compressed=%d uncompressed=%zu)\n",
+            compressedBytes, n);
+
+      // if (n < lastByte)
+      //   throw std::runtime_error("invalid RLE data (count too small)");
+
+      if (n < reader.lastByte)
+        std::fill(scanline+n, scanline+reader.lastByte, 0);
+      row = scanline + reader.firstByte;
+      break;
+    }
+
+    // The whole scanline is needed to inflate it
+    case CompressionMethod::ZIPWithoutPrediction:
+    case CompressionMethod::ZIPWithPrediction:
+      if (direct && reader.lastByte == reader.rowBytes)
+        scanline = dst;
+      inflateRow(*reader.inflater, scanline, reader.rowBytes);
+      if (inside &&
+          img.compressionMethod == CompressionMethod::ZIPWithPrediction)
+        undo_zip_prediction(scanline, img.width, img.depth, reader.tmp);
+      row = scanline + reader.firstByte;
+      break;
+
+    default:
+      throw std::runtime_error("Unknown compression method");
+  }
+
+  if (!ok())
+    throw std::runtime_error("end-of-file not expected");
+
+  if (!inside)
+    return nullptr;
+
+  if (img.scale > 1) {
+    uint8_t* out = (dst ? dst: reader.scaled.data());
+    downsample_row(row, out, img.region.width(), img.depth, img.scale);
+    row = out;
+  }
+  else if (dst && row != dst) {
+    std::copy(row, row+reader.outBytes, dst);
+    row = dst;
+  }
+
+  // Convert values to the requested byte order
+  if (reader.swapBytes) {
+    uint8_t* out = (dst ? dst:
+                    img.scale > 1 ? reader.scaled.data():
+                                    reader.scanline.data() + reader.firstByte);
+    if (img.depth == 16)
+      byteswap_16(row, out, reader.outWidth);
+    else
+      byteswap_32(row, out, reader.outWidth);
+    row = out;
+  }
+
+  return row;
+}
+
+// Decodes RLE scanlines by blocks of rows. The compressed data of all
+// the rows of the block is read at once (the offset of each row is
+// known from the byte counts table), and the rows are decompressed
+// in the threads of the pool. Then the rows are given to the delegate
+// in order from this thread.
+void Decoder::readRLEParallel(const ImageData& img,
+                              const std::vector<uint32_t>& byteCounts,
+                              const bool swapBytes)
+{
+  const Region& region = img.region;
+  const size_t firstByte = row_bytes(region.left, img.depth);
+  const size_t lastByte = row_bytes(region.right, img.depth);
+  const int scale = img.scale;
+  const size_t outWidth = (region.width() + scale - 1) / scale;
+  const size_t outBytes = row_bytes(outWidth, img.depth);
+
+  // Rows to decode in each channel (one of each "scale" rows)
+  const size_t nrows = (region.height() + scale - 1) / scale;
+  const size_t blockRows =
+    std::min(nrows,
+             std::max(kParallelBlockSize / std::max<size_t>(lastByte, 1),
+                      size_t(m_threadPool->threads())));
+
+  std::vector<uint8_t> block(blockRows * lastByte);
+  std::vector<uint8_t> scaled(scale > 1 ? blockRows * outBytes: 0);
+  std::vector<uint8_t> buffer;
+  std::vector<size_t> offsets(blockRows);
+  std::vector<const uint8_t*> rows(blockRows);
+
+  uint64_t pos = tell();
+  for (size_t c=0; c<img.channels.size(); ++c) {
+    const uint32_t* counts = &byteCounts[c * img.height];
+
+    // Buffer to decode the rows directly
+    int stride = 0;
+    uint8_t* plane =
+      (m_delegate ? m_delegate->channelPlane(img, img.channels[c], stride):
+                    nullptr);
+
+    // Skip rows before the region
+    for (int y=0; y<region.top; ++y)
+      pos += counts[y];
+
+    for (size_t firstRow=0; firstRow<nrows; firstRow+=blockRows) {
+      const size_t n = std::min(blockRows, nrows-firstRow);
+
+      // Rows of the file in this block (including skipped rows)
+      const int y0 = region.top + int(firstRow)*scale;
+      const int y1 = std::min(y0 + int(n)*scale, int(region.bottom));
+
+      size_t size = 0;
+      for (int y=y0; y<y1; ++y) {
+        if ((y - y0) % scale == 0)
+          offsets[(y - y0) / scale] = size;
+        size += counts[y];
+      }
+
+      seek(pos);
+      const uint8_t* compressedData = readView(size, buffer);
+      if (!ok())
+        throw std::runtime_error("end-of-file not expected");
+      pos += size;
+
+      m_threadPool->parallelFor(
+        n, [&](size_t i){
+          uint8_t* dst = (plane ? plane + (firstRow+i)*stride: nullptr);
+          uint8_t* row = (dst && scale == 1 && firstByte == 0 ?
+                          dst: block.data() + i*lastByte);
+          const int y = y0 + int(i)*scale;
+          const size_t k = unpack_bits(compressedData + offsets[i],
+                                       counts[y], row, lastByte);
+          if (k < lastByte)
+            std::fill(row+k, row+lastByte, 0);
+
+          row += firstByte;
+          if (scale > 1) {
+            if (!dst)
+              dst = scaled.data() + i*outBytes;
+            downsample_row(row, dst, region.width(), img.depth, scale);
+            row = dst;
+          }
+          else if (dst && row != dst) {
+            std::copy(row, row+outBytes, dst);
+            row = dst;
+          }
+
+          if (swapBytes) {
+            if (img.depth == 16)
+              byteswap_16(row, row, outWidth);
+            else
+              byteswap_32(row, row, outWidth);
+          }
+          rows[i] = row;
+        });
+
+      if (plane)
+        continue;
+
+      // The rows of the block are contiguous
+      if (m_delegate && m_delegate->supportsImageRows()) {
+        const size_t blockStride = (scale > 1 ? outBytes: lastByte);
+        for (size_t i=0; i<n; ) {
+          const size_t k =
+            std::min(n-i, std::max<size_t>(1, kImageRowsBlockSize / blockStride));
+          m_delegate->onImageRows(
+            img, y0/scale + int(i), int(k), img.channels[c],
+            rows[i], int(blockStride));
+          i += k;
+        }
+      }
+      else if (m_delegate) {
+        for (size_t i=0; i<n; ++i) {
+          m_delegate->onImageScanline(
+            img, y0/scale + int(i), img.channels[c],
+            rows[i], outBytes);
+        }
+      }
     }
+
+    // Skip rows after the region
+    for (int y=region.bottom; y<img.height; ++y)
+      pos += counts[y];
   }
+}
 
-  if (m_delegate)
-    m_delegate->onEndImage(img);
+// Returns the region of an image (placed at the given position of the
+// document) that must be decoded, relative to the image.
+Region Decoder::imageRegion(const int left, const int top,
+                            const int width, const int height) const
+{
+  Region region;
+  region.right = width;
+  region.bottom = height;
+
+  const Region& clip = m_options.region;
+  if (!clip.isEmpty()) {
+    region.left = std::min(std::max(clip.left - left, 0), width);
+    region.top = std::min(std::max(clip.top - top, 0), height);
+    region.right = std::min(std::max(clip.right - left, 0), width);
+    region.bottom = std::min(std::max(clip.bottom - top, 0), height);
+    if (region.isEmpty())
+      return Region();
+  }
 
-  return true;
+  // Downsampled images start at a multiple of the scale, and 1-bit
+  // scanlines are given in whole bytes
+  const int scale = m_options.scale;
+  if (scale != 1 && scale != 2 && scale != 4 && scale != 8)
+    throw std::runtime_error("Invalid scale");
+
+  const int align = (m_header.depth == 1 ? 8*scale: scale);
+  region.left -= region.left % align;
+  region.top -= region.top % scale;
+  if (m_header.depth == 1)
+    region.right = std::min((region.right+align-1) / align * align, width);
+  return region;
 }
 
 } // namespace psd
@@ -0,0 +1,171 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "psd.h"
+
+#include <stdexcept>
+
+namespace psd {
+
+// Collects the layer records (including layers of 16/32-bit files,
+// which are stored in Lr16/Lr32 tagged blocks)
+class LayersCollector : public DecoderDelegate {
+public:
+  LayersCollector(std::vector<LayerRecord>& layers) : m_layers(layers) { }
+
+  void onBeginLayer(const LayerRecord& layer) override {
+    m_layers.push_back(layer);
+  }
+
+private:
+  std::vector<LayerRecord>& m_layers;
+};
+
+Document::Document(FileInterface* file,
+                   const DecoderOptions& options)
+  : m_decoder(file, nullptr, options)
+  , m_imageDataOffset(0)
+{
+}
+
+Document::~Document()
+{
+}
+
+bool Document::load()
+{
+  m_layers.clear();
+  m_channels.clear();
+
+  LayersCollector collector(m_layers);
+  const bool metadataOnly = m_decoder.m_options.metadataOnly;
+  m_decoder.setDelegate(&collector);
+  m_decoder.m_options.metadataOnly = true;
+
+  bool result = true;
+  try {
+    m_decoder.readFileHeader();
+    m_decoder.readColorModeData();
+    m_decoder.readImageResources();
+    m_decoder.readLayersAndMask();
+    m_imageDataOffset = m_decoder.tell();
+
+    // Read the compression method of each channel
+    m_channels.resize(m_layers.size());
+    for (size_t i=0; i<m_layers.size(); ++i) {
+      for (const Channel& channel : m_layers[i].channels) {
+        ChannelEntry entry;
+        entry.channelID = channel.channelID;
+        entry.offset = channel.offset;
+        entry.length = channel.length;
+        entry.compressionMethod = CompressionMethod::RawImageData;
+        if (channel.length >= 2) {
+          uint8_t value[2];
+          m_decoder.readBytesAt(channel.offset, value, 2);
+          entry.compressionMethod =
+            CompressionMethod((value[0] << 8) | value[1]); // Big endian
+        }
+        m_channels[i].push_back(entry);
+      }
+    }
+    if (!m_decoder.ok())
+      throw std::runtime_error("end-of-file not expected");
+  }
+  catch (const std::exception&) {
+    result = false;
+  }
+
+  m_decoder.setDelegate(nullptr);
+  m_decoder.m_options.metadataOnly = metadataOnly;
+  return result;
+}
+
+const Document::ChannelEntry* Document::findChannel(const size_t layerIndex,
+                                                    const ChannelID chanID) const
+{
+  for (const ChannelEntry& entry : m_channels[layerIndex]) {
+    if (entry.channelID == chanID)
+      return &entry;
+  }
+  return nullptr;
+}
+
+bool Document::decodeLayer(const size_t layerIndex,
+                           DecoderDelegate* delegate)
+{
+  const LayerRecord& layerRecord = m_layers[layerIndex];
+
+  // The events go through the Decoder delegate (which can be an
+  // Interleaver for the given delegate), and it's asked which
+  // channels must be decoded as in the Decoder::readLayersInfo()
+  m_decoder.setDelegate(delegate);
+  DecoderDelegate* decoderDelegate = m_decoder.m_delegate;
+  std::vector<bool> channels;
+  const bool decode = m_decoder.getChannelsToDecode(layerRecord, channels);
+  if (decoderDelegate)
+    decoderDelegate->onBeginLayer(layerRecord);
+  const bool result = (!decode ||
+                       decodeLayerChannels(layerIndex, channels));
+  if (decoderDelegate)
+    decoderDelegate->onEndLayer(layerRecord);
+  m_decoder.setDelegate(nullptr);
+  return result;
+}
+
+bool Document::decodeLayerChannel(const size_t layerIndex,
+                                  const ChannelID chanID,
+                                  DecoderDelegate* delegate)
+{
+  const LayerRecord& layerRecord = m_layers[layerIndex];
+  std::vector<bool> channels(layerRecord.channels.size(), false);
+  bool found = false;
+  for (size_t i=0; i<channels.size(); ++i) {
+    if (layerRecord.channels[i].channelID == chanID)
+      channels[i] = found = true;
+  }
+  if (!found)
+    return false;
+
+  // Only one channel, it's always given as a planar channel
+  m_decoder.m_delegate = delegate;
+  const bool result = decodeLayerChannels(layerIndex, channels);
+  m_decoder.m_delegate = nullptr;
+  return result;
+}
+
+bool Document::decodeLayerChannels(const size_t layerIndex,
+                                   const std::vector<bool>& channels)
+{
+  const LayerRecord& layerRecord = m_layers[layerIndex];
+  if (layerRecord.channels.empty())
+    return true;
+
+  try {
+    m_decoder.seek(layerRecord.channels[0].offset);
+    m_decoder.readLayerImage(layerRecord, channels);
+  }
+  catch (const std::exception&) {
+    return false;
+  }
+  return true;
+}
+
+bool Document::decodeImageData(DecoderDelegate* delegate)
+{
+  bool result = true;
+  m_decoder.setDelegate(delegate);
+  try {
+    m_decoder.seek(m_imageDataOffset);
+    m_decoder.readImageData();
+  }
+  catch (const std::exception&) {
+    result = false;
+  }
+  m_decoder.setDelegate(nullptr);
+  return result;
+}
+
+} // namespace psd
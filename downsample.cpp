@@ -0,0 +1,90 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "psd_downsample.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace psd {
+
+static uint32_t load_be32(const uint8_t* p)
+{
+  return ((uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+          (uint32_t(p[2]) << 8) | uint32_t(p[3]));
+}
+
+static void store_be32(uint8_t* p, const uint32_t value)
+{
+  p[0] = uint8_t(value >> 24);
+  p[1] = uint8_t(value >> 16);
+  p[2] = uint8_t(value >> 8);
+  p[3] = uint8_t(value);
+}
+
+void downsample_row(const uint8_t* src, uint8_t* dst,
+                    const size_t width, const int depth,
+                    const int scale)
+{
+  const size_t n = (width + scale - 1) / scale;
+
+  switch (depth) {
+
+    case 1:
+      std::memset(dst, 0, (n+7) / 8);
+      for (size_t i=0, x=0; i<n; ++i, x+=scale) {
+        const size_t count = std::min<size_t>(scale, width - x);
+        size_t set = 0;
+        for (size_t j=x; j<x+count; ++j)
+          set += (src[j/8] >> (7 - (j&7))) & 1;
+        if (2*set >= count)
+          dst[i/8] |= (0x80 >> (i&7));
+      }
+      break;
+
+    case 8:
+      for (size_t i=0, x=0; i<n; ++i, x+=scale) {
+        const size_t count = std::min<size_t>(scale, width - x);
+        uint32_t sum = 0;
+        for (size_t j=0; j<count; ++j)
+          sum += src[x+j];
+        dst[i] = uint8_t((sum + count/2) / count);
+      }
+      break;
+
+    case 16:
+      for (size_t i=0, x=0; i<n; ++i, x+=scale) {
+        const size_t count = std::min<size_t>(scale, width - x);
+        uint32_t sum = 0;
+        for (size_t j=0; j<count; ++j)
+          sum += (uint32_t(src[2*(x+j)]) << 8) | src[2*(x+j)+1];
+        const uint32_t value = (sum + count/2) / count;
+        dst[2*i] = uint8_t(value >> 8);
+        dst[2*i+1] = uint8_t(value);
+      }
+      break;
+
+    // 32-bit samples are floats
+    case 32:
+      for (size_t i=0, x=0; i<n; ++i, x+=scale) {
+        const size_t count = std::min<size_t>(scale, width - x);
+        float sum = 0.0f;
+        for (size_t j=0; j<count; ++j) {
+          const uint32_t bits = load_be32(src + 4*(x+j));
+          float value;
+          std::memcpy(&value, &bits, 4);
+          sum += value;
+        }
+        const float value = sum / float(count);
+        uint32_t bits;
+        std::memcpy(&bits, &value, 4);
+        store_be32(dst + 4*i, bits);
+      }
+      break;
+  }
+}
+
+} // namespace psd
@@ -0,0 +1,141 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "psd.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+  #include <io.h>
+#else
+  #include <cerrno>
+  #include <unistd.h>
+#endif
+
+namespace psd {
+
+// Reads/writes up to "size" bytes at the given position without using
+// the file pointer of the descriptor.
+static size_t read_at(int fd, uint64_t pos, uint8_t* buf, size_t size)
+{
+  size_t total = 0;
+  while (total < size) {
+#ifdef _WIN32
+    OVERLAPPED overlapped = { };
+    overlapped.Offset = DWORD(pos & 0xffffffff);
+    overlapped.OffsetHigh = DWORD(pos >> 32);
+    DWORD n = 0;
+    if (!ReadFile((HANDLE)_get_osfhandle(fd), buf,
+                  DWORD(std::min<size_t>(size - total, 0x40000000)),
+                  &n, &overlapped) || n == 0)
+      break;
+#else
+    const ssize_t n = pread(fd, buf, size - total, off_t(pos));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+#endif
+    buf += n;
+    pos += n;
+    total += n;
+  }
+  return total;
+}
+
+static size_t write_at(int fd, uint64_t pos, const uint8_t* buf, size_t size)
+{
+  size_t total = 0;
+  while (total < size) {
+#ifdef _WIN32
+    OVERLAPPED overlapped = { };
+    overlapped.Offset = DWORD(pos & 0xffffffff);
+    overlapped.OffsetHigh = DWORD(pos >> 32);
+    DWORD n = 0;
+    if (!WriteFile((HANDLE)_get_osfhandle(fd), buf,
+                   DWORD(std::min<size_t>(size - total, 0x40000000)),
+                   &n, &overlapped) || n == 0)
+      break;
+#else
+    const ssize_t n = pwrite(fd, buf, size - total, off_t(pos));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+#endif
+    buf += n;
+    pos += n;
+    total += n;
+  }
+  return total;
+}
+
+FdFileInterface::FdFileInterface(int fd)
+  : m_fd(fd)
+  , m_pos(0)
+  , m_ok(fd >= 0)
+{
+}
+
+bool FdFileInterface::ok() const
+{
+  return m_ok;
+}
+
+uint64_t FdFileInterface::tell()
+{
+  return m_pos;
+}
+
+void FdFileInterface::seek(uint64_t absPos)
+{
+  m_pos = absPos;
+}
+
+uint8_t FdFileInterface::read8()
+{
+  uint8_t value;
+  if (readSome(&value, 1) == 1)
+    return value;
+
+  m_ok = false;
+  return 0;
+}
+
+bool FdFileInterface::read(uint8_t* buf, uint32_t size)
+{
+  return (readSome(buf, size) == size);
+}
+
+size_t FdFileInterface::readSome(uint8_t* buf, size_t size)
+{
+  const size_t n = readAt(m_pos, buf, size);
+  m_pos += n;
+  return n;
+}
+
+void FdFileInterface::write8(uint8_t value)
+{
+  write(&value, 1);
+}
+
+bool FdFileInterface::write(const uint8_t* buf, uint32_t size)
+{
+  const size_t n = write_at(m_fd, m_pos, buf, size);
+  m_pos += n;
+  return (n == size);
+}
+
+size_t FdFileInterface::readAt(uint64_t pos, uint8_t* buf, size_t size)
+{
+  return read_at(m_fd, pos, buf, size);
+}
+
+} // namespace psd
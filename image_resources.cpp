@@ -8,6 +8,7 @@
 #include "psd_debug.h"
 #include "psd_details.h"
 
+#include <algorithm>
 #include <stdexcept>
 
 namespace psd {
@@ -208,7 +209,7 @@ OSTypeClassMetaType Decoder::parseDescrVariable()
   }
   else {
     meta.name.resize(classIDLength);
-    m_file->read((uint8_t*)&meta.name[0], classIDLength);
+    readBytes((uint8_t*)&meta.name[0], classIDLength);
   }
   return meta;
 }
@@ -292,7 +293,7 @@ std::unique_ptr<OSTypeEnum> Decoder::parseEnumeratedType()
 std::unique_ptr<OSTypeAlias> Decoder::parseAliasType()
 {
   const uint32_t length = read32();
-  m_file->seek(m_file->tell() + length);
+  skip(length);
   return std::unique_ptr<OSTypeAlias>(new OSTypeAlias);
 }
 
@@ -375,6 +376,63 @@ std::unique_ptr<OSTypeDescriptor> Decoder::parseDescriptor()
   return desc;
 }
 
+// Reads the thumbnail header and data from the bytes of a thumbnail
+// resource (0x0409 or 0x040C). If "isView" is true, "data" points to
+// FileInterface::view() memory and the thumbnail data isn't copied.
+void Decoder::readThumbnail(const uint16_t resID,
+                            const uint8_t* data,
+                            const uint32_t length,
+                            const bool isView)
+{
+  // Prefer the Photoshop 5.0 thumbnail (RGB)
+  if (m_thumbnail && m_thumbnail->resourceID == 0x040C)
+    return;
+
+  const uint32_t kHeaderSize = 28;
+  if (length < kHeaderSize)
+    return;
+
+  auto get32 = [data](const int i) -> uint32_t {
+    return ((uint32_t(data[i]) << 24) | (uint32_t(data[i+1]) << 16) |
+            (uint32_t(data[i+2]) << 8) | uint32_t(data[i+3]));
+  };
+  auto get16 = [data](const int i) -> uint16_t {
+    return uint16_t((data[i] << 8) | data[i+1]);
+  };
+
+  std::unique_ptr<Thumbnail> thumb(new Thumbnail);
+  thumb->resourceID = resID;
+  const uint32_t format = get32(0);
+  thumb->width = get32(4);
+  thumb->height = get32(8);
+  thumb->widthBytes = get32(12);
+  // get32(16) is the total size = widthBytes * height * planes
+  const uint32_t compressedSize = get32(20);
+  thumb->bitsPerPixel = get16(24);
+  thumb->planes = get16(26);
+
+  if (format != uint32_t(Thumbnail::Format::RawRGB) &&
+      format != uint32_t(Thumbnail::Format::JpegRGB))
+    return;
+
+  thumb->format = Thumbnail::Format(format);
+  uint64_t size = length - kHeaderSize;
+  if (thumb->format == Thumbnail::Format::JpegRGB)
+    size = std::min<uint64_t>(size, compressedSize);
+  else
+    size = std::min<uint64_t>(size, uint64_t(thumb->widthBytes)
+                                    * thumb->height * thumb->planes);
+  thumb->size = size_t(size);
+
+  if (isView)
+    thumb->view = data + kHeaderSize;
+  else
+    thumb->buffer.assign(data + kHeaderSize,
+                         data + kHeaderSize + thumb->size);
+
+  m_thumbnail = std::move(thumb);
+}
+
 std::wstring Decoder::getUnicodeString()
 {
   const uint32_t length = read32();
@@ -0,0 +1,173 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "psd.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+namespace psd {
+
+// Data shared between the thread that feeds the data and the thread
+// that decodes it.
+struct IncrementalDecoder::State {
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::vector<uint8_t> data;    // Received data
+  uint64_t base = 0;            // File position of data[0]
+  uint64_t readEnd = 0;         // End of the last read data
+  bool forwardOnly = false;     // Data before readEnd can be discarded
+  bool eof = false;             // True if finish() was called
+  bool waiting = false;         // True if the decoder needs more data
+  bool finished = false;        // True if the decoder has finished
+  bool result = false;
+  std::thread thread;
+
+  // Reads the received data at the given position. When the data
+  // wasn't received yet, it blocks the decoder thread until the next
+  // feed() (or finish()) call.
+  size_t readAt(const uint64_t pos, uint8_t* buf, const size_t size) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (pos >= base + data.size() && !eof) {
+      waiting = true;
+      cond.notify_all();
+      cond.wait(lock);
+    }
+    if (pos < base || pos >= base + data.size())
+      return 0;
+
+    const size_t i = size_t(pos - base);
+    const size_t n = std::min(size, data.size() - i);
+    std::memcpy(buf, &data[i], n);
+    readEnd = pos + n;
+    return n;
+  }
+
+  // Gives the received data to the Decoder
+  class File : public FileInterface {
+  public:
+    File(State& state) : m_state(state), m_pos(0), m_ok(true) { }
+
+    bool ok() const override { return m_ok; }
+    uint64_t tell() override { return m_pos; }
+    void seek(uint64_t absPos) override { m_pos = absPos; }
+
+    uint8_t read8() override {
+      uint8_t value;
+      if (readSome(&value, 1) == 1)
+        return value;
+
+      m_ok = false;
+      return 0;
+    }
+
+    bool read(uint8_t* buf, uint32_t size) override {
+      size_t n = 0;
+      while (n < size) {
+        const size_t k = readSome(buf+n, size-n);
+        if (k == 0)
+          break;
+        n += k;
+      }
+      return (n == size);
+    }
+
+    size_t readSome(uint8_t* buf, size_t size) override {
+      const size_t n = m_state.readAt(m_pos, buf, size);
+      m_pos += n;
+      return n;
+    }
+
+    void write8(uint8_t value) override { m_ok = false; }
+    bool write(const uint8_t* buf, uint32_t size) override {
+      m_ok = false;
+      return false;
+    }
+
+  private:
+    State& m_state;
+    uint64_t m_pos;
+    bool m_ok;
+  };
+};
+
+IncrementalDecoder::IncrementalDecoder(DecoderDelegate* delegate,
+                                       const DecoderOptions& options)
+  : m_state(new State)
+{
+  State* state = m_state.get();
+  state->forwardOnly = options.forwardOnly;
+  state->thread = std::thread(
+    [state, delegate, options]{
+      State::File file(*state);
+      const bool result = decode_psd(&file, delegate, options);
+
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->result = result;
+      state->finished = true;
+      state->cond.notify_all();
+    });
+}
+
+IncrementalDecoder::~IncrementalDecoder()
+{
+  finish();
+}
+
+bool IncrementalDecoder::feed(const uint8_t* data, const size_t size)
+{
+  std::unique_lock<std::mutex> lock(m_state->mutex);
+  if (m_state->finished || m_state->eof)
+    return (m_state->finished && m_state->result);
+
+  // The decoder doesn't need the data that was already read (it
+  // keeps its own look-behind buffer)
+  if (m_state->forwardOnly && m_state->readEnd > m_state->base) {
+    const size_t n = size_t(std::min<uint64_t>(m_state->readEnd - m_state->base,
+                                               m_state->data.size()));
+    m_state->data.erase(m_state->data.begin(), m_state->data.begin()+n);
+    m_state->base += n;
+  }
+
+  m_state->data.insert(m_state->data.end(), data, data+size);
+  m_state->waiting = false;
+  m_state->cond.notify_all();
+
+  // Wait until the decoder needs more data
+  while (!m_state->waiting && !m_state->finished)
+    m_state->cond.wait(lock);
+
+  return (!m_state->finished || m_state->result);
+}
+
+bool IncrementalDecoder::finish()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_state->mutex);
+    m_state->eof = true;
+    m_state->cond.notify_all();
+    while (!m_state->finished)
+      m_state->cond.wait(lock);
+  }
+
+  if (m_state->thread.joinable())
+    m_state->thread.join();
+
+  m_state->data.clear();
+  m_state->data.shrink_to_fit();
+  return m_state->result;
+}
+
+bool IncrementalDecoder::done() const
+{
+  std::lock_guard<std::mutex> lock(m_state->mutex);
+  return m_state->finished;
+}
+
+} // namespace psd
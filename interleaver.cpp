@@ -0,0 +1,310 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "psd_interleaver.h"
+
+#include "psd_simd.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace psd {
+
+Interleaver::Interleaver(const PixelLayout layout,
+                         const bool littleEndian)
+  : m_delegate(nullptr)
+  , m_layout(layout)
+  , m_littleEndian(littleEndian)
+  , m_enabled(false)
+  , m_gray(false)
+  , m_inLayer(false)
+  , m_hasImage(false)
+  , m_rowBytes(0)
+  , m_rows(0)
+{
+}
+
+void Interleaver::onFileHeader(const FileHeader& fileHeader)
+{
+  // Only RGB and grayscale images of 8, 16, or 32 bits are
+  // interleaved, other images are given as planar channels
+  m_enabled = ((fileHeader.colorMode == ColorMode::RGB ||
+                fileHeader.colorMode == ColorMode::Grayscale) &&
+               fileHeader.depth >= 8);
+  m_gray = (fileHeader.colorMode == ColorMode::Grayscale);
+
+  if (m_delegate)
+    m_delegate->onFileHeader(fileHeader);
+}
+
+void Interleaver::onColorModeData(const ColorModeData& data)
+{
+  if (m_delegate)
+    m_delegate->onColorModeData(data);
+}
+
+void Interleaver::onImageResources(const ImageResources& res)
+{
+  if (m_delegate)
+    m_delegate->onImageResources(res);
+}
+
+void Interleaver::onImageResource(const ImageResource& res)
+{
+  if (m_delegate)
+    m_delegate->onImageResource(res);
+}
+
+void Interleaver::onLayersAndMask(const LayersInformation& layers)
+{
+  if (m_delegate)
+    m_delegate->onLayersAndMask(layers);
+}
+
+void Interleaver::onLayersInfo(const LayersInformation& layers)
+{
+  if (m_delegate)
+    m_delegate->onLayersInfo(layers);
+}
+
+void Interleaver::onImageData(const ImageData& imageData)
+{
+  if (m_delegate)
+    m_delegate->onImageData(imageData);
+}
+
+void Interleaver::onBeginLayer(const LayerRecord& layer)
+{
+  if (m_delegate)
+    m_delegate->onBeginLayer(layer);
+
+  m_inLayer = true;
+  m_hasImage = false;
+}
+
+void Interleaver::onEndLayer(const LayerRecord& layer)
+{
+  // All the channels of the layer were decoded
+  if (m_enabled)
+    flush();
+  m_inLayer = false;
+
+  if (m_delegate)
+    m_delegate->onEndLayer(layer);
+}
+
+void Interleaver::onSlicesData(const Slices& slices)
+{
+  if (m_delegate)
+    m_delegate->onSlicesData(slices);
+}
+
+void Interleaver::onFramesData(const std::vector<FrameInformation>& framesInfo,
+                               const uint32_t activeFrameIndex)
+{
+  if (m_delegate)
+    m_delegate->onFramesData(framesInfo, activeFrameIndex);
+}
+
+void Interleaver::onBeginImage(const ImageData& img)
+{
+  if (!m_enabled) {
+    if (m_delegate)
+      m_delegate->onBeginImage(img);
+    return;
+  }
+
+  // Each channel of a layer is a different image
+  if (!m_inLayer || !m_hasImage)
+    beginImage(img);
+
+  m_img.channels.insert(m_img.channels.end(),
+                        img.channels.begin(), img.channels.end());
+}
+
+void Interleaver::onImageScanline(const ImageData& img,
+                                  const int y,
+                                  const ChannelID chanID,
+                                  const uint8_t* data,
+                                  const int bytes)
+{
+  // Channels without plane are ignored
+  if (!m_enabled && m_delegate)
+    m_delegate->onImageScanline(img, y, chanID, data, bytes);
+}
+
+void Interleaver::onEndImage(const ImageData& img)
+{
+  if (!m_enabled) {
+    if (m_delegate)
+      m_delegate->onEndImage(img);
+    return;
+  }
+
+  if (!m_inLayer)
+    flush();
+}
+
+void Interleaver::onImageRows(const ImageData& img,
+                              const int y0,
+                              const int nrows,
+                              const ChannelID chanID,
+                              const uint8_t* data,
+                              const int stride)
+{
+  if (!m_enabled && m_delegate)
+    m_delegate->onImageRows(img, y0, nrows, chanID, data, stride);
+}
+
+bool Interleaver::supportsImageRows() const
+{
+  return (m_enabled || (m_delegate && m_delegate->supportsImageRows()));
+}
+
+uint8_t* Interleaver::channelPlane(const ImageData& img,
+                                   const ChannelID chanID,
+                                   int& stride)
+{
+  if (!m_enabled)
+    return (m_delegate ? m_delegate->channelPlane(img, chanID, stride):
+                         nullptr);
+
+  const int i = planeIndex(img, chanID);
+  if (i < 0)
+    return nullptr;
+
+  m_planes[i].assign(m_rowBytes * m_rows, 0);
+  stride = int(m_rowBytes);
+  return m_planes[i].data();
+}
+
+bool Interleaver::decodeLayer(const LayerRecord& layer)
+{
+  return (m_delegate ? m_delegate->decodeLayer(layer): true);
+}
+
+bool Interleaver::decodeChannel(const LayerRecord& layer,
+                                const Channel& channel)
+{
+  // Masks are not used in the interleaved pixels
+  if (m_enabled && channel.channelID != ChannelID::Red &&
+      channel.channelID != ChannelID::Green &&
+      channel.channelID != ChannelID::Blue &&
+      channel.channelID != ChannelID::TransparencyMask)
+    return false;
+
+  return (m_delegate ? m_delegate->decodeChannel(layer, channel): true);
+}
+
+int Interleaver::planeIndex(const ImageData& img, const ChannelID chanID) const
+{
+  // The channels of the merged image of grayscale files are the gray
+  // level and the alpha
+  if (m_gray && !m_inLayer) {
+    const auto it = std::find(img.channels.begin(), img.channels.end(), chanID);
+    switch (it - img.channels.begin()) {
+      case 0: return 0;
+      case 1: return 3;
+    }
+    return -1;
+  }
+
+  switch (chanID) {
+    case ChannelID::Red: return 0;
+    case ChannelID::Green: return (m_gray ? -1: 1);
+    case ChannelID::Blue: return (m_gray ? -1: 2);
+    case ChannelID::Alpha:
+    case ChannelID::TransparencyMask: return 3;
+    default: return -1;
+  }
+}
+
+void Interleaver::beginImage(const ImageData& img)
+{
+  m_hasImage = true;
+  m_img = img;
+  m_img.channels.clear();
+
+  const size_t width = (img.region.width() + img.scale - 1) / img.scale;
+  m_rowBytes = width * (img.depth / 8);
+  m_rows = (img.region.height() + img.scale - 1) / img.scale;
+
+  for (auto& plane : m_planes)
+    plane.clear();
+}
+
+// Gives the interleaved rows of the current image to the delegate
+void Interleaver::flush()
+{
+  if (!m_hasImage)
+    return;
+  m_hasImage = false;
+  if (!m_delegate)
+    return;
+
+  const int depth = m_img.depth;
+  const size_t width = m_rowBytes / (depth / 8);
+
+  // Missing color channels are zero, and missing alpha is opaque
+  // (rows with stride 0)
+  std::vector<uint8_t> zero;
+  std::vector<uint8_t> opaque;
+  const uint8_t* planes[4];
+  size_t strides[4];
+  for (int i=0; i<4; ++i) {
+    const int j = (m_gray && i < 3 ? 0: i);
+    strides[i] = m_rowBytes;
+    if (!m_planes[j].empty()) {
+      planes[i] = m_planes[j].data();
+      continue;
+    }
+
+    strides[i] = 0;
+    if (i < 3) {
+      zero.resize(m_rowBytes, 0);
+      planes[i] = zero.data();
+    }
+    else {
+      opaque.resize(m_rowBytes, 0xff);
+      if (depth == 32) {
+        // 1.0f is 0x3f800000
+        for (size_t k=0; k<width; ++k) {
+          uint8_t* v = &opaque[4*k];
+          v[0] = 0x3f; v[1] = 0x80; v[2] = 0; v[3] = 0;
+          if (m_littleEndian)
+            std::reverse(v, v+4);
+        }
+      }
+      planes[i] = opaque.data();
+    }
+  }
+
+  if (m_layout == PixelLayout::BGRA) {
+    std::swap(planes[0], planes[2]);
+    std::swap(strides[0], strides[2]);
+  }
+
+  m_row.resize(4 * m_rowBytes);
+  m_delegate->onBeginImage(m_img);
+  for (int y=0; y<m_rows; ++y) {
+    const uint8_t* p[4];
+    for (int i=0; i<4; ++i)
+      p[i] = planes[i] + y*strides[i];
+
+    switch (depth) {
+      case 8:  interleave_4x8(p[0], p[1], p[2], p[3], m_row.data(), width); break;
+      case 16: interleave_4x16(p[0], p[1], p[2], p[3], m_row.data(), width); break;
+      case 32: interleave_4x32(p[0], p[1], p[2], p[3], m_row.data(), width); break;
+    }
+
+    m_delegate->onInterleavedScanline(
+      m_img, m_img.region.top / m_img.scale + y,
+      m_row.data(), int(m_row.size()));
+  }
+  m_delegate->onEndImage(m_img);
+}
+
+} // namespace psd
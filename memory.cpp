@@ -0,0 +1,87 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "psd.h"
+
+#include <cstring>
+
+namespace psd {
+
+MemoryFileInterface::MemoryFileInterface(const uint8_t* data, size_t size)
+  : m_data(data)
+  , m_size(size)
+  , m_pos(0)
+  , m_ok(true)
+{
+}
+
+bool MemoryFileInterface::ok() const
+{
+  return m_ok;
+}
+
+uint64_t MemoryFileInterface::tell()
+{
+  return m_pos;
+}
+
+void MemoryFileInterface::seek(uint64_t absPos)
+{
+  m_pos = absPos;
+}
+
+uint8_t MemoryFileInterface::read8()
+{
+  if (m_pos < m_size)
+    return m_data[m_pos++];
+
+  m_ok = false;
+  return 0;
+}
+
+bool MemoryFileInterface::read(uint8_t* buf, uint32_t size)
+{
+  return (readSome(buf, size) == size);
+}
+
+size_t MemoryFileInterface::readSome(uint8_t* buf, size_t size)
+{
+  const size_t n = readAt(m_pos, buf, size);
+  m_pos += n;
+  return n;
+}
+
+void MemoryFileInterface::write8(uint8_t value)
+{
+  // Read-only
+}
+
+bool MemoryFileInterface::write(const uint8_t* buf, uint32_t size)
+{
+  return false;
+}
+
+const uint8_t* MemoryFileInterface::view(uint64_t pos, size_t len)
+{
+  if (pos > m_size || len > m_size - pos)
+    return nullptr;
+  return m_data + pos;
+}
+
+size_t MemoryFileInterface::readAt(uint64_t pos, uint8_t* buf, size_t size)
+{
+  size_t n = size;
+  if (pos >= m_size)
+    n = 0;
+  else if (n > m_size - pos)
+    n = m_size - pos;
+
+  if (n > 0)
+    std::memcpy(buf, m_data + pos, n);
+  return n;
+}
+
+} // namespace psd
@@ -0,0 +1,97 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "psd.h"
+
+#include <cstdint>
+
+#ifdef _WIN32
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace psd {
+
+MmapFileInterface::MmapFileInterface(const char* filename)
+  : MemoryFileInterface(nullptr, 0)
+#ifdef _WIN32
+  , m_handle(INVALID_HANDLE_VALUE)
+  , m_mapping(nullptr)
+#endif
+{
+  m_ok = false;
+
+#ifdef _WIN32
+  m_handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ,
+                         nullptr, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (m_handle == INVALID_HANDLE_VALUE)
+    return;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(m_handle, &size))
+    return;
+
+  // The whole file must fit in the address space
+  if (uint64_t(size.QuadPart) > uint64_t(SIZE_MAX))
+    return;
+
+  m_size = size_t(size.QuadPart);
+  m_ok = true;
+  if (m_size == 0)              // Empty files cannot be mapped
+    return;
+
+  m_mapping = CreateFileMappingA(m_handle, nullptr, PAGE_READONLY,
+                                 0, 0, nullptr);
+  if (m_mapping)
+    m_data = (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return;
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 &&
+      uint64_t(st.st_size) <= uint64_t(SIZE_MAX)) {
+    m_size = size_t(st.st_size);
+    m_ok = true;
+    if (m_size > 0) {
+      void* ptr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (ptr != MAP_FAILED)
+        m_data = (const uint8_t*)ptr;
+    }
+  }
+  // The mapping keeps its own reference to the file
+  close(fd);
+#endif
+
+  if (m_size > 0 && !m_data)
+    m_ok = false;
+}
+
+MmapFileInterface::~MmapFileInterface()
+{
+#ifdef _WIN32
+  if (m_data)
+    UnmapViewOfFile((void*)m_data);
+  if (m_mapping)
+    CloseHandle(m_mapping);
+  if (m_handle != INVALID_HANDLE_VALUE)
+    CloseHandle(m_handle);
+#else
+  if (m_data)
+    munmap((void*)m_data, m_size);
+#endif
+}
+
+} // namespace psd
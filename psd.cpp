@@ -6,6 +6,8 @@
 
 #include "psd.h"
 
+#include <utility>
+
 namespace psd {
 
 const char* color_mode_string(const ColorMode colorMode)
@@ -23,10 +25,22 @@ const char* color_mode_string(const ColorMode colorMode)
   return "Unknown";
 }
 
+size_t FileInterface::readSome(uint8_t* buf, size_t size)
+{
+  size_t i = 0;
+  for (; i<size; ++i) {
+    buf[i] = read8();
+    if (!ok())
+      break;
+  }
+  return i;
+}
+
 bool decode_psd(FileInterface* file,
-                DecoderDelegate* delegate)
+                DecoderDelegate* delegate,
+                const DecoderOptions& options)
 {
-  Decoder decoder(file, delegate);
+  Decoder decoder(file, delegate, options);
 
   try {
     decoder.readFileHeader();
@@ -41,4 +55,25 @@ bool decode_psd(FileInterface* file,
   return true;
 }
 
+bool decode_psd_thumbnail(FileInterface* file, Thumbnail& thumbnail)
+{
+  Decoder decoder(file, nullptr);
+
+  try {
+    decoder.readFileHeader();
+    decoder.readColorModeData();
+    decoder.readImageResources();
+  }
+  catch (const std::exception&) {
+    return false;
+  }
+
+  std::unique_ptr<Thumbnail> thumb = decoder.takeThumbnail();
+  if (!thumb)
+    return false;
+
+  thumbnail = std::move(*thumb);
+  return true;
+}
+
 } // namespace psd
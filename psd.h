@@ -14,6 +14,7 @@
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace psd {
@@ -79,6 +80,34 @@ namespace psd {
     std::vector<ImageResource> resources;
   };
 
+  // Thumbnail embedded in the image resources 0x0409 (Photoshop 4.0,
+  // with BGR pixels) or 0x040C (Photoshop 5.0+, RGB pixels)
+  struct Thumbnail {
+    enum class Format : uint32_t {
+      RawRGB = 0,
+      JpegRGB = 1,
+    };
+
+    uint16_t resourceID = 0;
+    Format format = Format::JpegRGB;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t widthBytes = 0;    // Bytes per raw scanline (padded to 4)
+    uint16_t bitsPerPixel = 0;
+    uint16_t planes = 0;
+
+    // Thumbnail data (a JPEG file or raw pixels). If the
+    // FileInterface supports view(), the data is not copied and
+    // "view" points to it (valid while the file is open), in other
+    // case the data is copied in "buffer".
+    const uint8_t* view = nullptr;
+    std::vector<uint8_t> buffer;
+    size_t size = 0;
+
+    const uint8_t* data() const { return (view ? view: buffer.data()); }
+    bool isBGR() const { return resourceID == 0x0409; }
+  };
+
   enum class LayerBlendMode : uint32_t {
     PassThrough = PSD_DEFINE_DWORD('p', 'a', 's', 's'),
     Normal = PSD_DEFINE_DWORD('n', 'o', 'r', 'm'),
@@ -245,6 +274,7 @@ namespace psd {
   struct Channel {
     ChannelID channelID;
     uint64_t length;
+    uint64_t offset;            // File position of the channel data
   };
 
   struct OSType {
@@ -530,12 +560,37 @@ namespace psd {
     ZIPWithPrediction = 3,
   };
 
+  // Rectangular region of an image (right and bottom are exclusive)
+  struct Region {
+    int32_t top = 0;
+    int32_t left = 0;
+    int32_t bottom = 0;
+    int32_t right = 0;
+
+    int width() const { return right - left; }
+    int height() const { return bottom - top; }
+    bool isEmpty() const { return (right <= left || bottom <= top); }
+  };
+
   struct ImageData {
     CompressionMethod compressionMethod;
     int width;
     int height;
     int depth;
     std::vector<ChannelID> channels;
+
+    // Part of the image that is decoded (relative to the image, see
+    // DecoderOptions::region). onImageScanline() is called only for
+    // the rows of this region, and each scanline contains only the
+    // pixels from region.left to region.right (for 1-bit images the
+    // region is expanded to start/end in a byte boundary).
+    Region region;
+
+    // Downsampling factor (see DecoderOptions::scale). If it's > 1,
+    // "region" starts at a multiple of the scale, the "y" given to
+    // onImageScanline() is divided by the scale, and each scanline
+    // contains (region.width()+scale-1)/scale pixels.
+    int scale = 1;
   };
 
   class FileInterface {
@@ -546,28 +601,51 @@ namespace psd {
     virtual bool ok() const = 0;
 
     // Current position in the file
-    virtual size_t tell() = 0;
+    virtual uint64_t tell() = 0;
 
     // Jump to the given position in the file
-    virtual void seek(size_t absPos) = 0;
+    virtual void seek(uint64_t absPos) = 0;
 
     // Returns the next byte in the file or 0 if ok() = false
     virtual uint8_t read8() = 0;
     virtual bool read(uint8_t* buf, uint32_t size) = 0;
 
+    // Reads up to "size" bytes and returns the number of bytes that
+    // were read (less than "size" at the end of the file, or if the
+    // rest of the data is not available yet in a stream, but 0 only
+    // at the end of the file). The default implementation reads byte
+    // by byte with read8().
+    virtual size_t readSome(uint8_t* buf, size_t size);
+
     // Writes one byte in the file (or do nothing if ok() = false)
     virtual void write8(uint8_t value) = 0;
     virtual bool write(const uint8_t* buf, uint32_t size) = 0;
+
+    // Returns a pointer to "len" bytes of the file starting at the
+    // absolute position "pos" without copying them, or nullptr if
+    // this kind of access isn't supported (or the range is out of
+    // the file). The position in the file is not modified.
+    virtual const uint8_t* view(uint64_t pos, size_t len) { return nullptr; }
+
+    // Returns true if readAt() is supported.
+    virtual bool canReadAt() const { return false; }
+
+    // Reads up to "size" bytes starting at the absolute position
+    // "pos" and returns the number of bytes that were read. It doesn't
+    // use or modify the current position in the file, so it can be
+    // called from several threads at the same time.
+    virtual size_t readAt(uint64_t pos, uint8_t* buf, size_t size) { return 0; }
   };
 
   class StdioFileInterface : public psd::FileInterface {
   public:
     StdioFileInterface(FILE* file);
     bool ok() const override;
-    size_t tell() override;
-    void seek(size_t absPos) override;
+    uint64_t tell() override;
+    void seek(uint64_t absPos) override;
     uint8_t read8() override;
     bool read(uint8_t* buf, uint32_t size) override;
+    size_t readSome(uint8_t* buf, size_t size) override;
     void write8(uint8_t value) override;
     bool write(const uint8_t* buf, uint32_t size) override;
 
@@ -576,6 +654,73 @@ namespace psd {
     bool m_ok;
   };
 
+  // Uses a file descriptor opened by the caller (it's not closed by
+  // this class). All reads are positional (pread() on POSIX), so the
+  // same descriptor can be shared by several threads with readAt().
+  class FdFileInterface : public psd::FileInterface {
+  public:
+    FdFileInterface(int fd);
+    bool ok() const override;
+    uint64_t tell() override;
+    void seek(uint64_t absPos) override;
+    uint8_t read8() override;
+    bool read(uint8_t* buf, uint32_t size) override;
+    size_t readSome(uint8_t* buf, size_t size) override;
+    void write8(uint8_t value) override;
+    bool write(const uint8_t* buf, uint32_t size) override;
+    bool canReadAt() const override { return true; }
+    size_t readAt(uint64_t pos, uint8_t* buf, size_t size) override;
+
+  private:
+    int m_fd;
+    uint64_t m_pos;
+    bool m_ok;
+  };
+
+  // Reads a document that is already loaded in memory. The data is
+  // owned by the caller and must be alive while this object is used.
+  class MemoryFileInterface : public psd::FileInterface {
+  public:
+    MemoryFileInterface(const uint8_t* data, size_t size);
+    bool ok() const override;
+    uint64_t tell() override;
+    void seek(uint64_t absPos) override;
+    uint8_t read8() override;
+    bool read(uint8_t* buf, uint32_t size) override;
+    size_t readSome(uint8_t* buf, size_t size) override;
+    void write8(uint8_t value) override;
+    bool write(const uint8_t* buf, uint32_t size) override;
+    const uint8_t* view(uint64_t pos, size_t len) override;
+    bool canReadAt() const override { return true; }
+    size_t readAt(uint64_t pos, uint8_t* buf, size_t size) override;
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+  protected:
+    const uint8_t* m_data;
+    size_t m_size;
+    uint64_t m_pos;
+    bool m_ok;
+  };
+
+  // Maps the whole file in memory (read-only), so the decoder can
+  // access the image data through view() without copying it.
+  class MmapFileInterface : public psd::MemoryFileInterface {
+  public:
+    MmapFileInterface(const char* filename);
+    ~MmapFileInterface();
+
+  private:
+    MmapFileInterface(const MmapFileInterface&) = delete;
+    MmapFileInterface& operator=(const MmapFileInterface&) = delete;
+
+#ifdef _WIN32
+    void* m_handle;
+    void* m_mapping;
+#endif
+  };
+
   class DecoderDelegate {
   public:
     virtual ~DecoderDelegate() { }
@@ -600,15 +745,165 @@ namespace psd {
                                  const uint8_t* data,
                                  const int bytes) { }
     virtual void onEndImage(const ImageData& img) { }
+
+    // Receives several consecutive scanlines ("nrows" rows starting at
+    // "y0") of a channel at once, each one at "stride" bytes of the
+    // previous one. It's called instead of onImageScanline() only if
+    // supportsImageRows() returns true, to avoid one call per row
+    // (e.g. in narrow images). The number of rows of each call is
+    // limited so the data fits in the cache.
+    virtual void onImageRows(const ImageData& img,
+                             const int y0,
+                             const int nrows,
+                             const ChannelID chanID,
+                             const uint8_t* data,
+                             const int stride) { }
+    virtual bool supportsImageRows() const { return false; }
+
+    // Returns a buffer where the scanlines of the given channel of
+    // the image are decoded directly (without giving them to
+    // onImageScanline() or onImageRows()), or nullptr to receive them
+    // in those functions. It's called after onBeginImage() for each
+    // channel. The first row of the buffer is the first row of
+    // img.region, and each row (with the same bytes given to
+    // onImageScanline()) is at "stride" bytes of the previous one.
+    virtual uint8_t* channelPlane(const ImageData& img,
+                                  const ChannelID chanID,
+                                  int& stride) { return nullptr; }
+
+    // Receives the rows of interleaved pixels (4 samples per pixel)
+    // when DecoderOptions::pixelLayout is RGBA or BGRA.
+    virtual void onInterleavedScanline(const ImageData& img,
+                                       const int y,
+                                       const uint8_t* data,
+                                       const int bytes) { }
+
+    // Return false to skip the image data of the given layer (or of
+    // one channel of the layer) without decompressing it. These are
+    // called before onBeginLayer() (when layers are decoded in
+    // parallel, they are called for all layers before decoding them).
+    // onBeginLayer() and onEndLayer() are called anyway.
+    virtual bool decodeLayer(const LayerRecord& layer) { return true; }
+    virtual bool decodeChannel(const LayerRecord& layer,
+                               const Channel& channel) { return true; }
+
+    // Returns true if the layers can be given to this delegate from
+    // several threads at the same time. Used when layers are decoded
+    // in parallel (DecoderOptions::threads > 1). In that case:
+    //
+    // * Each layer from onBeginLayer() to onEndLayer() is given from
+    //   only one thread, but the events of different layers are
+    //   interleaved in any order (not in the file order), e.g.
+    //   onBeginLayer(A), onBeginLayer(B), onEndLayer(B), onEndLayer(A).
+    //
+    // * onBeginImage(), onImageScanline() (or onImageRows() and
+    //   channelPlane()), and onEndImage() don't say which layer the
+    //   image belongs to, so the delegate must track the current
+    //   layer per thread (e.g. with a thread_local variable set in
+    //   onBeginLayer()).
+    //
+    // decodeLayer() and decodeChannel() are still called from the
+    // thread that called the Decoder before decoding the layers.
+    virtual bool isThreadSafe() const { return false; }
+  };
+
+  // Byte order of 16-bit and 32-bit values in the scanlines given to
+  // DecoderDelegate::onImageScanline()
+  enum class ByteOrder {
+    Native,                     // Byte order of the CPU
+    BigEndian,                  // Byte order used in PSD files
+    LittleEndian,
+  };
+
+  // Layout of the pixels given to the delegate
+  enum class PixelLayout {
+    Planar,                     // Each channel with onImageScanline()
+    RGBA,                       // Interleaved with onInterleavedScanline()
+    BGRA,
+  };
+
+  struct DecoderOptions {
+    ByteOrder byteOrder = ByteOrder::Native;
+
+    // Number of threads used to decompress image data (0 = one per
+    // CPU core). Scanlines are given to the delegate in order and from
+    // the thread that called the Decoder, unless the delegate is
+    // thread-safe: then the layers are given from the worker threads
+    // at the same time and their events are interleaved in any order
+    // (see DecoderDelegate::isThreadSafe()).
+    int threads = 1;
+
+    // If it's true, the image data of layers and of the merged image
+    // is not decoded (the channels data is skipped using the
+    // channels/sections lengths), only the structure of the file
+    // (header, resources, layer records, etc.) is read.
+    bool metadataOnly = false;
+
+    // Region of the document to decode (in document coordinates, the
+    // same as the layers bounds). If it's empty (the default) the
+    // whole images are decoded, in other case only the intersection
+    // of each image (merged image or layer) with this region is
+    // decoded and layers outside the region are skipped.
+    Region region;
+
+    // Downsampling factor (1, 2, 4 or 8) to decode quick previews.
+    // With scale > 1 each image is decoded at 1/scale of its size:
+    // only the first row of each group of "scale" rows is
+    // decompressed (the others are skipped), and each group of
+    // "scale" pixels of that row is averaged.
+    int scale = 1;
+
+    // If it's true, the file is read only forward (FileInterface::seek()
+    // and view() are never used) to decode pipes, stdin, or other
+    // non-seekable streams. Skipped data is read and discarded. The
+    // Decoder reads the sections of a valid file in only one pass,
+    // and the last "lookBehind" bytes are kept in memory to go back
+    // when a block was parsed beyond its length (e.g. a malformed
+    // descriptor). Going back further is an error, so Document and
+    // ScanlineReader cannot be used in this mode to decode layers
+    // out of order.
+    bool forwardOnly = false;
+    size_t lookBehind = 64*1024;
+
+    // With RGBA or BGRA, the channels of each layer (or of the merged
+    // image) of RGB and grayscale files are converted to interleaved
+    // pixels (RGBA8, RGBA16, or RGBA32F depending on the depth of the
+    // file, with the samples in the requested byte order). The
+    // TransparencyMask channel of layers is used as alpha (it's
+    // opaque if there is no alpha) and masks are skipped. The whole
+    // image is given to DecoderDelegate::onInterleavedScanline()
+    // between onBeginImage() and onEndImage() when all its channels
+    // are decoded (before onEndLayer() for layers). Other files (or
+    // 1-bit images) are still given as planar channels.
+    PixelLayout pixelLayout = PixelLayout::Planar;
   };
 
+  class Document;
+  class Inflater;
+  class Interleaver;
+  class ScanlineReader;
+  class ThreadPool;
+  struct RowReader;
+
   class Decoder {
   public:
     Decoder(FileInterface* file,
-            DecoderDelegate* delegate);
+            DecoderDelegate* delegate,
+            const DecoderOptions& options = DecoderOptions());
+    ~Decoder();
 
     const FileHeader& fileHeader() const { return m_header; }
 
+    // Thumbnail found in readImageResources() (nullptr if the file
+    // doesn't have one)
+    const Thumbnail* thumbnail() const { return m_thumbnail.get(); }
+
+    // Gives the ownership of the thumbnail (and its data) to the
+    // caller, thumbnail() returns nullptr after this.
+    std::unique_ptr<Thumbnail> takeThumbnail() {
+      return std::move(m_thumbnail);
+    }
+
     bool readFileHeader();
     bool readColorModeData();
     bool readImageResources();
@@ -617,16 +912,37 @@ namespace psd {
     bool getSlices(const OSTypeDescriptor* desc, Slices& slices);
 
   private:
+    void setDelegate(DecoderDelegate* delegate);
     bool readLayersInfo(LayersInformation& layers);
     bool readLayersInfo(const uint64_t length, LayersInformation& layers);
     bool readLayerRecord(LayersInformation& layers,
                          LayerRecord& layerRecord);
     bool readGlobalMaskInfo(LayersInformation& layers);
+    bool getChannelsToDecode(const LayerRecord& layerRecord,
+                             std::vector<bool>& channels);
+    void readLayerImage(const LayerRecord& layerRecord,
+                        const std::vector<bool>& channels);
+    void readLayersImageParallel(const std::vector<LayerRecord>& layers);
+    std::vector<ChannelID> imageDataChannels() const;
     bool readImage(const ImageData& img);
+    const uint8_t* readRow(RowReader& reader,
+                           const bool inside,
+                           const uint32_t compressedBytes,
+                           uint8_t* dst);
+    void readRLEParallel(const ImageData& img,
+                         const std::vector<uint32_t>& byteCounts,
+                         const bool swapBytes);
+    Region imageRegion(const int left, const int top,
+                       const int width, const int height) const;
+    void inflateRow(Inflater& inflater, uint8_t* row, size_t n);
     bool readSectionDivider(LayerRecord& layerRecord, const uint64_t length);
     bool readLayerMLSTSection(LayerRecord& layerRecord);
     bool readLayerTMLNSection(LayerRecord& layerRecord);
     bool readLayerCUSTSection(LayerRecord& layerRecord);
+    void readThumbnail(const uint16_t resID,
+                       const uint8_t* data,
+                       const uint32_t length,
+                       const bool isView);
     bool readResourceSlicesV6();
     bool readResourceSlices();
     uint64_t readAdditionalLayerInfo(LayerRecord& layerRecord);
@@ -641,7 +957,25 @@ namespace psd {
     OSTypeClassMetaType parseDescrVariable();
     std::wstring getUnicodeString();
 
-    uint8_t read8() { return m_file->read8(); }
+    // The file is read by blocks in m_buffer, and values are decoded
+    // directly from there (instead of calling FileInterface::read8()
+    // for each byte).
+    bool ok() const { return m_ok; }
+    uint64_t tell() const { return m_bufferPos + m_bufferIdx; }
+    void seek(const uint64_t absPos);
+    void skip(const uint64_t n) { seek(tell() + n); }
+    bool fillBuffer(const size_t n);
+    void seekFile(const uint64_t pos);
+    const uint8_t* fileView(const uint64_t pos, const size_t n);
+    void readBytes(uint8_t* buf, const size_t n);
+    void readBytesAt(const uint64_t pos, uint8_t* buf, const size_t n);
+    const uint8_t* readView(const size_t n, std::vector<uint8_t>& buffer);
+
+    uint8_t read8() {
+      if (m_bufferIdx < m_bufferLen || fillBuffer(1))
+        return m_buffer[m_bufferIdx++];
+      return 0;
+    }
     uint16_t read16();
     uint32_t read32();
     uint64_t read64();
@@ -652,9 +986,221 @@ namespace psd {
     DecoderDelegate* m_delegate;
     FileInterface* m_file;
     FileHeader m_header;
+    DecoderOptions m_options;
+    bool m_swapBytes;
+    std::unique_ptr<ThreadPool> m_threadPool;
+    std::unique_ptr<Thumbnail> m_thumbnail;
+    std::unique_ptr<Interleaver> m_interleaver;
+
+    std::vector<uint8_t> m_buffer;
+    uint64_t m_bufferPos;       // File position of m_buffer[0]
+    size_t m_bufferIdx;         // Next byte to read in m_buffer
+    size_t m_bufferLen;         // Number of valid bytes in m_buffer
+    uint64_t m_filePos;         // Current position of m_file
+    bool m_ok;
+
+    friend class Document;
+    friend class ScanlineReader;
   };
 
-  bool decode_psd(FileInterface* file, DecoderDelegate* delegate);
+  // Reads the structure of a file once (without decoding image data)
+  // and keeps an index of the channels data of each layer, so the
+  // image of any layer can be decoded later on demand.
+  class Document {
+  public:
+    struct ChannelEntry {
+      ChannelID channelID;
+      uint64_t offset;          // File position of the channel data
+      uint64_t length;          // Bytes including the compression method
+      CompressionMethod compressionMethod;
+    };
+
+    Document(FileInterface* file,
+             const DecoderOptions& options = DecoderOptions());
+    ~Document();
+
+    // Reads the header, resources and layer records of the file.
+    // Must be called (and return true) before using other functions.
+    bool load();
+
+    const FileHeader& fileHeader() const { return m_decoder.fileHeader(); }
+    const Thumbnail* thumbnail() const { return m_decoder.thumbnail(); }
+    const std::vector<LayerRecord>& layers() const { return m_layers; }
+
+    // Channels of the given layer (in the same order as
+    // LayerRecord::channels)
+    const std::vector<ChannelEntry>& channels(const size_t layerIndex) const {
+      return m_channels[layerIndex];
+    }
+    const ChannelEntry* findChannel(const size_t layerIndex,
+                                    const ChannelID chanID) const;
+
+    // Decode the image data of one layer (calling onBeginLayer() and
+    // onEndLayer() of the delegate too, and skipping the layer or
+    // channels as DecoderDelegate::decodeLayer()/decodeChannel()
+    // say), of only one channel of a layer (always as a planar
+    // channel), or of the merged image. They return false if the
+    // data cannot be decoded.
+    bool decodeLayer(const size_t layerIndex, DecoderDelegate* delegate);
+    bool decodeLayerChannel(const size_t layerIndex,
+                            const ChannelID chanID,
+                            DecoderDelegate* delegate);
+    bool decodeImageData(DecoderDelegate* delegate);
+
+  private:
+    Document(const Document&) = delete;
+    Document& operator=(const Document&) = delete;
+
+    bool decodeLayerChannels(const size_t layerIndex,
+                             const std::vector<bool>& channels);
+
+    Decoder m_decoder;
+    std::vector<LayerRecord> m_layers;
+    std::vector<std::vector<ChannelEntry>> m_channels;
+    uint64_t m_imageDataOffset;
+
+    friend class ScanlineReader;
+  };
+
+  // Decodes the scanlines of one channel of a layer (or of the merged
+  // image) of a loaded Document one by one, only when they are
+  // requested with nextRow(), so the user can pace the decoding. The
+  // options of the Document (byte order, region, and scale) are
+  // used. Several readers of the same Document can be used one after
+  // the other (e.g. one for each channel of a layer), but they cannot
+  // be used from different threads at the same time.
+  class ScanlineReader {
+  public:
+    // Reader for a channel of a layer
+    ScanlineReader(Document& doc,
+                   const size_t layerIndex,
+                   const ChannelID chanID);
+    // Reader for a channel of the merged image
+    ScanlineReader(Document& doc,
+                   const ChannelID chanID);
+    ~ScanlineReader();
+
+    // Returns false if the channel doesn't exist or it cannot be
+    // decoded (e.g. the file is truncated).
+    bool ok() const { return m_ok; }
+
+    // Image being decoded (with the region and scale of the rows)
+    const ImageData& image() const { return m_img; }
+    ChannelID channelID() const { return m_img.channels[0]; }
+
+    // Number of rows to decode, bytes of each row, and index of the
+    // next row returned by nextRow()
+    int rows() const { return m_rows; }
+    int rowBytes() const { return m_rowBytes; }
+    int y() const { return m_y; }
+
+    // Decodes the next scanline, the returned pointer is valid until
+    // the next call. Returns nullptr if there are no more rows (or in
+    // case of error).
+    const uint8_t* nextRow();
+
+  private:
+    ScanlineReader(const ScanlineReader&) = delete;
+    ScanlineReader& operator=(const ScanlineReader&) = delete;
+
+    void init(const uint64_t pos, const size_t nchannels,
+              const size_t channelIndex);
+
+    Decoder& m_decoder;
+    ImageData m_img;
+    std::unique_ptr<RowReader> m_reader;
+    std::vector<uint32_t> m_byteCounts;
+    uint64_t m_pos;             // File position of the next row
+    int m_srcRow;               // Next row of the file to read
+    int m_firstRow;             // First row of this channel in the file
+    int m_rows;
+    int m_rowBytes;
+    int m_y;
+    bool m_ok;
+  };
+
+  // Decodes the scanlines of all the channels of a layer at the same
+  // time, one row each time.
+  class LayerReader {
+  public:
+    LayerReader(Document& doc, const size_t layerIndex);
+    ~LayerReader();
+
+    // Returns false if the layer doesn't exist or one of its
+    // channels cannot be decoded.
+    bool ok() const;
+    const LayerRecord& layer() const { return m_layer; }
+
+    // Readers of each channel (in the same order as
+    // LayerRecord::channels)
+    size_t channels() const { return m_readers.size(); }
+    const ScanlineReader& channel(const size_t i) const {
+      return *m_readers[i];
+    }
+
+    int rows() const;
+    int y() const;
+
+    // Decodes the next row of each channel. Returns false if there are
+    // no more rows (or in case of error).
+    bool nextRow();
+
+    // Scanline of the given channel decoded in the last nextRow()
+    // call (valid until the next call)
+    const uint8_t* row(const size_t channelIndex) const {
+      return m_rowsData[channelIndex];
+    }
+
+  private:
+    const LayerRecord& m_layer;
+    std::vector<std::unique_ptr<ScanlineReader>> m_readers;
+    std::vector<const uint8_t*> m_rowsData;
+    bool m_ok;
+  };
+
+  // Decodes a file which data is received by chunks (e.g. from the
+  // network), calling the delegate as soon as each part of the file
+  // can be decoded, without waiting for the whole file. The decoder
+  // runs in its own thread, but the delegate is called only while
+  // feed() or finish() are waiting for it, so it's never called at
+  // the same time as the user code that gives the data. The received
+  // data is kept in memory until the end (or only the data that is not
+  // decoded yet if DecoderOptions::forwardOnly is used).
+  class IncrementalDecoder {
+  public:
+    IncrementalDecoder(DecoderDelegate* delegate,
+                       const DecoderOptions& options = DecoderOptions());
+    ~IncrementalDecoder();
+
+    // Gives the next "size" bytes of the file. Returns when all the
+    // data received until now is decoded. Returns false if the file
+    // cannot be decoded (in that case the rest of the data is not
+    // needed).
+    bool feed(const uint8_t* data, const size_t size);
+
+    // Indicates that there is no more data (decoding the rest of the
+    // file with the received data). Returns the same result as
+    // decode_psd().
+    bool finish();
+
+    // Returns true if the decoder has finished (successfully or not).
+    bool done() const;
+
+  private:
+    IncrementalDecoder(const IncrementalDecoder&) = delete;
+    IncrementalDecoder& operator=(const IncrementalDecoder&) = delete;
+
+    struct State;
+    std::unique_ptr<State> m_state;
+  };
+
+  bool decode_psd(FileInterface* file, DecoderDelegate* delegate,
+                  const DecoderOptions& options = DecoderOptions());
+
+  // Reads only the beginning of the file (until the image resources)
+  // to get the embedded thumbnail. Returns false if the file cannot
+  // be read or it doesn't contain a thumbnail.
+  bool decode_psd_thumbnail(FileInterface* file, Thumbnail& thumbnail);
 
 } // namespace psd
 
@@ -0,0 +1,27 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef PSD_DOWNSAMPLE_H_INCLUDED
+#define PSD_DOWNSAMPLE_H_INCLUDED
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace psd {
+
+  // Reduces the "width" pixels of the scanline "src" (big-endian
+  // samples of the given depth) to (width+scale-1)/scale pixels in
+  // "dst", averaging each group of "scale" pixels (the last group can
+  // be smaller). 1-bit pixels are set if at least half of the group
+  // is set.
+  void downsample_row(const uint8_t* src, uint8_t* dst,
+                      const size_t width, const int depth,
+                      const int scale);
+
+} // namespace psd
+
+#endif
@@ -0,0 +1,91 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef PSD_INTERLEAVER_H_INCLUDED
+#define PSD_INTERLEAVER_H_INCLUDED
+#pragma once
+
+#include "psd.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace psd {
+
+  // Delegate used by the Decoder when DecoderOptions::pixelLayout is
+  // RGBA or BGRA. The channels of each image (all the channel images
+  // of a layer, or the merged image) are decoded directly in its
+  // planes, and when the image is complete the interleaved rows are
+  // given to DecoderDelegate::onInterleavedScanline() of the user
+  // delegate. Other events are forwarded to the user delegate.
+  class Interleaver : public DecoderDelegate {
+  public:
+    // "littleEndian" is the byte order of the 16-bit and 32-bit samples
+    Interleaver(const PixelLayout layout, const bool littleEndian);
+
+    DecoderDelegate* delegate() const { return m_delegate; }
+    void setDelegate(DecoderDelegate* delegate) { m_delegate = delegate; }
+
+    void onFileHeader(const FileHeader& fileHeader) override;
+    void onColorModeData(const ColorModeData& data) override;
+    void onImageResources(const ImageResources& res) override;
+    void onImageResource(const ImageResource& res) override;
+    void onLayersAndMask(const LayersInformation& layers) override;
+    void onLayersInfo(const LayersInformation& layers) override;
+    void onImageData(const ImageData& imageData) override;
+    void onBeginLayer(const LayerRecord& layer) override;
+    void onEndLayer(const LayerRecord& layer) override;
+    void onSlicesData(const Slices& slices) override;
+    void onFramesData(const std::vector<FrameInformation>& framesInfo,
+                      const uint32_t activeFrameIndex) override;
+    void onBeginImage(const ImageData& img) override;
+    void onImageScanline(const ImageData& img,
+                         const int y,
+                         const ChannelID chanID,
+                         const uint8_t* data,
+                         const int bytes) override;
+    void onEndImage(const ImageData& img) override;
+    void onImageRows(const ImageData& img,
+                     const int y0,
+                     const int nrows,
+                     const ChannelID chanID,
+                     const uint8_t* data,
+                     const int stride) override;
+    bool supportsImageRows() const override;
+    uint8_t* channelPlane(const ImageData& img,
+                          const ChannelID chanID,
+                          int& stride) override;
+    bool decodeLayer(const LayerRecord& layer) override;
+    bool decodeChannel(const LayerRecord& layer,
+                       const Channel& channel) override;
+
+  private:
+    // Returns the index of the plane (0=red/gray, 1=green, 2=blue,
+    // 3=alpha) for the given channel, or -1 if the channel is not
+    // used.
+    int planeIndex(const ImageData& img, const ChannelID chanID) const;
+    void beginImage(const ImageData& img);
+    void flush();
+
+    DecoderDelegate* m_delegate;
+    PixelLayout m_layout;
+    bool m_littleEndian;
+    bool m_enabled;             // False if the pixels stay planar
+    bool m_gray;                // Grayscale file
+    bool m_inLayer;
+
+    // Current image (with all the channels of the layer)
+    bool m_hasImage;
+    ImageData m_img;
+    size_t m_rowBytes;          // Bytes of each row of each plane
+    int m_rows;
+    std::vector<uint8_t> m_planes[4];
+    std::vector<uint8_t> m_row;
+  };
+
+} // namespace psd
+
+#endif
@@ -0,0 +1,25 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef PSD_RLE_H_INCLUDED
+#define PSD_RLE_H_INCLUDED
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace psd {
+
+  // Decompresses the PackBits data in "src" (one whole compressed
+  // scanline) into "dst". Literal runs are copied and repeated runs
+  // are filled by blocks. Returns the number of bytes written in
+  // "dst" (which is never more than "dstSize").
+  size_t unpack_bits(const uint8_t* src, const size_t srcSize,
+                     uint8_t* dst, const size_t dstSize);
+
+} // namespace psd
+
+#endif
@@ -0,0 +1,56 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef PSD_ROW_READER_H_INCLUDED
+#define PSD_ROW_READER_H_INCLUDED
+#pragma once
+
+#include "psd.h"
+#include "psd_zip.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace psd {
+
+  // State to decode the scanlines of an image one by one with
+  // Decoder::readRow() (used by Decoder::readImage() and by
+  // ScanlineReader to decode rows on demand).
+  struct RowReader {
+    RowReader(const ImageData& img, const bool swapBytes);
+
+    // Returns true if the scanline "y" of a channel must be given to
+    // the user (it's inside the region and it's not skipped by the
+    // downsampling).
+    bool isInside(const int y) const {
+      return (y >= img.region.top && y < img.region.bottom &&
+              (y - img.region.top) % img.scale == 0);
+    }
+
+    const ImageData img;
+    const bool swapBytes;
+
+    size_t rowBytes;            // Bytes in each scanline of the file
+    size_t firstByte;           // Bytes of the scanline inside the region
+    size_t lastByte;
+    size_t regionBytes;
+    size_t outWidth;            // Pixels/bytes given to the user
+    size_t outBytes;
+
+    std::vector<uint8_t> scanline;
+    std::vector<uint8_t> scaled; // Downsampled scanline
+    std::vector<uint8_t> buffer; // To read data without view()
+    std::vector<uint8_t> tmp;    // To undo the ZIP prediction
+
+    // All channels are compressed in one ZIP stream
+    std::unique_ptr<Inflater> inflater;
+  };
+
+} // namespace psd
+
+#endif
@@ -0,0 +1,62 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef PSD_SIMD_H_INCLUDED
+#define PSD_SIMD_H_INCLUDED
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define PSD_SSE2 1
+#endif
+
+namespace psd {
+
+  // Pixel processing kernels. All of them have a SSE2 version and a
+  // portable version for other platforms.
+
+  // Replaces each byte with the sum of all previous bytes (modulo
+  // 256), i.e. undoes a horizontal delta encoding of 8-bit values.
+  void prefix_sum_8(uint8_t* data, const size_t n);
+
+  // Same as prefix_sum_8() but for "n" 16-bit big-endian values.
+  void prefix_sum_16be(uint8_t* data, const size_t n);
+
+  // Copies "n" 16-bit values from "src" to "dst" swapping the two
+  // bytes of each value ("src" and "dst" can be the same pointer).
+  void byteswap_16(const uint8_t* src, uint8_t* dst, const size_t n);
+
+  // Same as byteswap_16() but with 32-bit values (the order of the 4
+  // bytes of each value is reversed).
+  void byteswap_32(const uint8_t* src, uint8_t* dst, const size_t n);
+
+  // Interleaves 4 planes of "n" bytes each one, so the output is
+  // p0[0] p1[0] p2[0] p3[0] p0[1] p1[1] ... (4*n bytes).
+  void interleave_4x8(const uint8_t* p0,
+                      const uint8_t* p1,
+                      const uint8_t* p2,
+                      const uint8_t* p3,
+                      uint8_t* out, const size_t n);
+
+  // Same as interleave_4x8() but with planes of "n" 16-bit or 32-bit
+  // values (the bytes of each value are copied in the same order).
+  void interleave_4x16(const uint8_t* p0,
+                       const uint8_t* p1,
+                       const uint8_t* p2,
+                       const uint8_t* p3,
+                       uint8_t* out, const size_t n);
+  void interleave_4x32(const uint8_t* p0,
+                       const uint8_t* p1,
+                       const uint8_t* p2,
+                       const uint8_t* p3,
+                       uint8_t* out, const size_t n);
+
+} // namespace psd
+
+#endif
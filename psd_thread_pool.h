@@ -0,0 +1,61 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef PSD_THREAD_POOL_H_INCLUDED
+#define PSD_THREAD_POOL_H_INCLUDED
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace psd {
+
+  // Set of worker threads used to decode image data in parallel.
+  class ThreadPool {
+  public:
+    // Creates a pool to run tasks in "nthreads" threads (the calling
+    // thread is one of them, so nthreads-1 workers are created).
+    ThreadPool(const int nthreads);
+    ~ThreadPool();
+
+    int threads() const { return int(m_workers.size()) + 1; }
+
+    // Calls fn(i) for each i in [0, n) from all threads (including
+    // the calling one) and waits until all calls have finished. If
+    // a call throws an exception, it's rethrown here.
+    void parallelFor(const size_t n,
+                     const std::function<void(size_t)>& fn);
+
+  private:
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void workerLoop();
+    void runTasks();
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_workCv;
+    std::condition_variable m_doneCv;
+    const std::function<void(size_t)>* m_fn;
+    size_t m_n;
+    std::atomic<size_t> m_next;
+    size_t m_pending;           // Workers that didn't finish yet
+    uint64_t m_generation;      // Incremented on each parallelFor()
+    std::exception_ptr m_error;
+    bool m_stop;
+  };
+
+} // namespace psd
+
+#endif
@@ -0,0 +1,50 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef PSD_ZIP_H_INCLUDED
+#define PSD_ZIP_H_INCLUDED
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace psd {
+
+  // Streaming decompressor for ZIP compressed image data. The data
+  // is inflated in small pieces (e.g. one scanline each time), so
+  // the whole channel never needs to be in memory.
+  class Inflater {
+  public:
+    Inflater();
+    ~Inflater();
+
+    // Decompresses bytes from "in" into "out". Both pointers (and
+    // sizes) are advanced with the consumed input and the produced
+    // output. Returns false when the end of the stream is reached.
+    bool inflate(const uint8_t*& in, size_t& inSize,
+                 uint8_t*& out, size_t& outSize);
+
+  private:
+    Inflater(const Inflater&) = delete;
+    Inflater& operator=(const Inflater&) = delete;
+
+    struct Stream;
+    std::unique_ptr<Stream> m_stream;
+  };
+
+  // Reverts the horizontal delta encoding of a ZIPWithPrediction
+  // scanline with "width" pixels of "depth" bits. 32-bit scanlines
+  // need a temporary buffer to rearrange their bytes.
+  void undo_zip_prediction(uint8_t* row,
+                           const int width,
+                           const int depth,
+                           std::vector<uint8_t>& tmp);
+
+} // namespace psd
+
+#endif
@@ -0,0 +1,46 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "psd_rle.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace psd {
+
+size_t unpack_bits(const uint8_t* src, const size_t srcSize,
+                   uint8_t* dst, const size_t dstSize)
+{
+  const uint8_t* srcEnd = src + srcSize;
+  uint8_t* d = dst;
+  uint8_t* dstEnd = dst + dstSize;
+
+  while (src < srcEnd && d < dstEnd) {
+    const int n = int8_t(*(src++));
+
+    // Copy the next n+1 bytes
+    if (n >= 0) {
+      const size_t count = std::min(size_t(n)+1, size_t(srcEnd - src));
+      const size_t copy = std::min(count, size_t(dstEnd - d));
+      std::memcpy(d, src, copy);
+      d += copy;
+      src += count;
+    }
+    // Repeat the next byte 1-n times
+    else if (n != -128) {
+      if (src == srcEnd)
+        break;
+      const size_t count = std::min(size_t(1-n), size_t(dstEnd - d));
+      std::memset(d, *(src++), count);
+      d += count;
+    }
+    // n == -128 is a no-op
+  }
+
+  return size_t(d - dst);
+}
+
+} // namespace psd
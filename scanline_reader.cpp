@@ -0,0 +1,226 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "psd.h"
+#include "psd_row_reader.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace psd {
+
+ScanlineReader::ScanlineReader(Document& doc,
+                               const size_t layerIndex,
+                               const ChannelID chanID)
+  : m_decoder(doc.m_decoder)
+  , m_pos(0)
+  , m_srcRow(0)
+  , m_firstRow(0)
+  , m_rows(0)
+  , m_rowBytes(0)
+  , m_y(0)
+  , m_ok(false)
+{
+  m_img.channels.push_back(chanID);
+  if (layerIndex >= doc.layers().size())
+    return;
+
+  const Document::ChannelEntry* entry = doc.findChannel(layerIndex, chanID);
+  if (!entry || entry->length < 2)
+    return;
+
+  const LayerRecord& layerRecord = doc.layers()[layerIndex];
+  m_img.depth = m_decoder.m_header.depth;
+  m_img.compressionMethod = entry->compressionMethod;
+  m_img.width = layerRecord.width();
+  m_img.height = layerRecord.height();
+
+  try {
+    m_img.region = m_decoder.imageRegion(layerRecord.left, layerRecord.top,
+                                         m_img.width, m_img.height);
+    init(entry->offset + 2, 1, 0);
+  }
+  catch (const std::exception&) {
+    m_ok = false;
+  }
+}
+
+ScanlineReader::ScanlineReader(Document& doc,
+                               const ChannelID chanID)
+  : m_decoder(doc.m_decoder)
+  , m_pos(0)
+  , m_srcRow(0)
+  , m_firstRow(0)
+  , m_rows(0)
+  , m_rowBytes(0)
+  , m_y(0)
+  , m_ok(false)
+{
+  m_img.channels.push_back(chanID);
+  m_img.depth = m_decoder.m_header.depth;
+  m_img.width = m_decoder.m_header.width;
+  m_img.height = m_decoder.m_header.height;
+
+  try {
+    const std::vector<ChannelID> channels = m_decoder.imageDataChannels();
+    size_t c = 0;
+    while (c < channels.size() && channels[c] != chanID)
+      ++c;
+    if (c == channels.size())
+      return;
+
+    m_decoder.seek(doc.m_imageDataOffset);
+    m_img.compressionMethod = CompressionMethod(m_decoder.read16());
+    m_img.region = m_decoder.imageRegion(0, 0, m_img.width, m_img.height);
+    init(m_decoder.tell(), channels.size(), c);
+  }
+  catch (const std::exception&) {
+    m_ok = false;
+  }
+}
+
+ScanlineReader::~ScanlineReader()
+{
+}
+
+// Prepares the reader for the channel "channelIndex" of an image with
+// "nchannels" channels which data (after the compression method)
+// starts at the given position.
+void ScanlineReader::init(const uint64_t pos,
+                          const size_t nchannels,
+                          const size_t channelIndex)
+{
+  switch (m_img.compressionMethod) {
+    case CompressionMethod::RawImageData:
+    case CompressionMethod::RLE:
+    case CompressionMethod::ZIPWithoutPrediction:
+    case CompressionMethod::ZIPWithPrediction:
+      break;
+    default:
+      throw std::runtime_error("Unknown compression method");
+  }
+
+  m_img.scale = m_decoder.m_options.scale;
+  m_decoder.seek(pos);
+
+  if (m_img.compressionMethod == CompressionMethod::RLE &&
+      !m_img.region.isEmpty()) {
+    m_byteCounts.resize(m_img.height * nchannels);
+    for (size_t i=0; i<m_byteCounts.size(); ++i)
+      m_byteCounts[i] = m_decoder.read16or32Length();
+    if (!m_decoder.ok())
+      throw std::runtime_error("end-of-file not expected");
+  }
+
+  // Samples are stored in big-endian
+  const bool swapBytes = (m_img.depth >= 16 && m_decoder.m_swapBytes);
+  m_reader.reset(new RowReader(m_img, swapBytes));
+
+  m_pos = m_decoder.tell();
+  m_firstRow = int(channelIndex) * m_img.height;
+  m_rows = (m_img.region.height() + m_img.scale - 1) / m_img.scale;
+  m_rowBytes = int(m_reader->outBytes);
+  m_ok = true;
+}
+
+const uint8_t* ScanlineReader::nextRow()
+{
+  if (!m_ok || m_y >= m_rows)
+    return nullptr;
+
+  const uint8_t* row = nullptr;
+  try {
+    // Other readers could have moved the position of the file
+    m_decoder.seek(m_pos);
+
+    // Skip rows of previous channels and rows outside the region
+    // until the next row to give to the user
+    while (!row) {
+      const int y = m_srcRow - m_firstRow;
+      row = m_decoder.readRow(
+        *m_reader, (y >= 0 && m_reader->isInside(y)),
+        m_byteCounts.empty() ? 0: m_byteCounts[m_srcRow],
+        nullptr);
+      ++m_srcRow;
+    }
+    m_pos = m_decoder.tell();
+  }
+  catch (const std::exception&) {
+    m_ok = false;
+    return nullptr;
+  }
+
+  // The row can point to the buffer of the Decoder, which is reused
+  // by other readers
+  const std::vector<uint8_t>& buffer = m_decoder.m_buffer;
+  if (row >= buffer.data() && row < buffer.data() + buffer.size()) {
+    uint8_t* dst = m_reader->scanline.data() + m_reader->firstByte;
+    std::memcpy(dst, row, m_rowBytes);
+    row = dst;
+  }
+
+  ++m_y;
+  return row;
+}
+
+// Layer of a LayerReader created with an invalid layer index
+static const LayerRecord kEmptyLayer = LayerRecord();
+
+LayerReader::LayerReader(Document& doc, const size_t layerIndex)
+  : m_layer(layerIndex < doc.layers().size() ? doc.layers()[layerIndex]:
+                                               kEmptyLayer)
+  , m_ok(layerIndex < doc.layers().size())
+{
+  if (!m_ok)
+    return;
+
+  for (const Channel& channel : m_layer.channels) {
+    m_readers.emplace_back(
+      new ScanlineReader(doc, layerIndex, channel.channelID));
+  }
+  m_rowsData.resize(m_readers.size(), nullptr);
+}
+
+LayerReader::~LayerReader()
+{
+}
+
+bool LayerReader::ok() const
+{
+  if (!m_ok)
+    return false;
+
+  for (const auto& reader : m_readers) {
+    if (!reader->ok())
+      return false;
+  }
+  return true;
+}
+
+int LayerReader::rows() const
+{
+  return (m_readers.empty() ? 0: m_readers[0]->rows());
+}
+
+int LayerReader::y() const
+{
+  return (m_readers.empty() ? 0: m_readers[0]->y());
+}
+
+bool LayerReader::nextRow()
+{
+  if (m_readers.empty())
+    return false;
+
+  for (size_t i=0; i<m_readers.size(); ++i) {
+    m_rowsData[i] = m_readers[i]->nextRow();
+    if (!m_rowsData[i])
+      return false;
+  }
+  return true;
+}
+
+} // namespace psd
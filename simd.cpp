@@ -0,0 +1,224 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "psd_simd.h"
+
+#ifdef PSD_SSE2
+  #include <emmintrin.h>
+#endif
+
+namespace psd {
+
+void prefix_sum_8(uint8_t* data, const size_t n)
+{
+  size_t i = 0;
+  uint8_t prev = 0;
+
+#ifdef PSD_SSE2
+  __m128i carry = _mm_setzero_si128();
+  for (; i+16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(data+i));
+    v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+    v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+    v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+    v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+    v = _mm_add_epi8(v, carry);
+    _mm_storeu_si128((__m128i*)(data+i), v);
+
+    // Broadcast the last byte to be added to the next 16 bytes
+    carry = _mm_unpackhi_epi8(v, v);
+    carry = _mm_unpackhi_epi16(carry, carry);
+    carry = _mm_shuffle_epi32(carry, 0xff);
+  }
+  if (i > 0)
+    prev = data[i-1];
+#endif
+
+  for (; i<n; ++i)
+    data[i] = prev = uint8_t(prev + data[i]);
+}
+
+void prefix_sum_16be(uint8_t* data, const size_t n)
+{
+  size_t i = 0;
+  uint16_t prev = 0;
+
+#ifdef PSD_SSE2
+  __m128i carry = _mm_setzero_si128();
+  for (; i+8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(data+2*i));
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    v = _mm_add_epi16(v, _mm_slli_si128(v, 2));
+    v = _mm_add_epi16(v, _mm_slli_si128(v, 4));
+    v = _mm_add_epi16(v, _mm_slli_si128(v, 8));
+    v = _mm_add_epi16(v, carry);
+
+    // Broadcast the last value to be added to the next 8 values
+    carry = _mm_shufflehi_epi16(v, 0xff);
+    carry = _mm_shuffle_epi32(carry, 0xff);
+
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    _mm_storeu_si128((__m128i*)(data+2*i), v);
+  }
+  if (i > 0)
+    prev = uint16_t((data[2*i-2] << 8) | data[2*i-1]);
+#endif
+
+  for (; i<n; ++i) {
+    prev = uint16_t(prev + ((data[2*i] << 8) | data[2*i+1]));
+    data[2*i] = uint8_t(prev >> 8);
+    data[2*i+1] = uint8_t(prev);
+  }
+}
+
+void byteswap_16(const uint8_t* src, uint8_t* dst, const size_t n)
+{
+  size_t i = 0;
+
+#ifdef PSD_SSE2
+  for (; i+8 <= n; i += 8) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)(src+2*i));
+    _mm_storeu_si128((__m128i*)(dst+2*i),
+                     _mm_or_si128(_mm_slli_epi16(v, 8),
+                                  _mm_srli_epi16(v, 8)));
+  }
+#endif
+
+  for (; i<n; ++i) {
+    const uint8_t a = src[2*i];
+    dst[2*i] = src[2*i+1];
+    dst[2*i+1] = a;
+  }
+}
+
+void byteswap_32(const uint8_t* src, uint8_t* dst, const size_t n)
+{
+  size_t i = 0;
+
+#ifdef PSD_SSE2
+  for (; i+4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(src+4*i));
+    // Swap 16-bit words, and then the bytes of each word
+    v = _mm_shufflelo_epi16(v, 0xb1);
+    v = _mm_shufflehi_epi16(v, 0xb1);
+    _mm_storeu_si128((__m128i*)(dst+4*i),
+                     _mm_or_si128(_mm_slli_epi16(v, 8),
+                                  _mm_srli_epi16(v, 8)));
+  }
+#endif
+
+  for (; i<n; ++i) {
+    const uint8_t a = src[4*i];
+    const uint8_t b = src[4*i+1];
+    dst[4*i] = src[4*i+3];
+    dst[4*i+1] = src[4*i+2];
+    dst[4*i+2] = b;
+    dst[4*i+3] = a;
+  }
+}
+
+void interleave_4x8(const uint8_t* p0,
+                    const uint8_t* p1,
+                    const uint8_t* p2,
+                    const uint8_t* p3,
+                    uint8_t* out, const size_t n)
+{
+  size_t i = 0;
+
+#ifdef PSD_SSE2
+  for (; i+16 <= n; i += 16, out += 64) {
+    const __m128i a = _mm_loadu_si128((const __m128i*)(p0+i));
+    const __m128i b = _mm_loadu_si128((const __m128i*)(p1+i));
+    const __m128i c = _mm_loadu_si128((const __m128i*)(p2+i));
+    const __m128i d = _mm_loadu_si128((const __m128i*)(p3+i));
+    const __m128i abLo = _mm_unpacklo_epi8(a, b);
+    const __m128i abHi = _mm_unpackhi_epi8(a, b);
+    const __m128i cdLo = _mm_unpacklo_epi8(c, d);
+    const __m128i cdHi = _mm_unpackhi_epi8(c, d);
+    _mm_storeu_si128((__m128i*)(out   ), _mm_unpacklo_epi16(abLo, cdLo));
+    _mm_storeu_si128((__m128i*)(out+16), _mm_unpackhi_epi16(abLo, cdLo));
+    _mm_storeu_si128((__m128i*)(out+32), _mm_unpacklo_epi16(abHi, cdHi));
+    _mm_storeu_si128((__m128i*)(out+48), _mm_unpackhi_epi16(abHi, cdHi));
+  }
+#endif
+
+  for (; i<n; ++i) {
+    *(out++) = p0[i];
+    *(out++) = p1[i];
+    *(out++) = p2[i];
+    *(out++) = p3[i];
+  }
+}
+
+void interleave_4x16(const uint8_t* p0,
+                     const uint8_t* p1,
+                     const uint8_t* p2,
+                     const uint8_t* p3,
+                     uint8_t* out, const size_t n)
+{
+  size_t i = 0;
+
+#ifdef PSD_SSE2
+  for (; i+8 <= n; i += 8, out += 64) {
+    const __m128i a = _mm_loadu_si128((const __m128i*)(p0+2*i));
+    const __m128i b = _mm_loadu_si128((const __m128i*)(p1+2*i));
+    const __m128i c = _mm_loadu_si128((const __m128i*)(p2+2*i));
+    const __m128i d = _mm_loadu_si128((const __m128i*)(p3+2*i));
+    const __m128i abLo = _mm_unpacklo_epi16(a, b);
+    const __m128i abHi = _mm_unpackhi_epi16(a, b);
+    const __m128i cdLo = _mm_unpacklo_epi16(c, d);
+    const __m128i cdHi = _mm_unpackhi_epi16(c, d);
+    _mm_storeu_si128((__m128i*)(out   ), _mm_unpacklo_epi32(abLo, cdLo));
+    _mm_storeu_si128((__m128i*)(out+16), _mm_unpackhi_epi32(abLo, cdLo));
+    _mm_storeu_si128((__m128i*)(out+32), _mm_unpacklo_epi32(abHi, cdHi));
+    _mm_storeu_si128((__m128i*)(out+48), _mm_unpackhi_epi32(abHi, cdHi));
+  }
+#endif
+
+  for (; i<n; ++i, out += 8) {
+    out[0] = p0[2*i]; out[1] = p0[2*i+1];
+    out[2] = p1[2*i]; out[3] = p1[2*i+1];
+    out[4] = p2[2*i]; out[5] = p2[2*i+1];
+    out[6] = p3[2*i]; out[7] = p3[2*i+1];
+  }
+}
+
+void interleave_4x32(const uint8_t* p0,
+                     const uint8_t* p1,
+                     const uint8_t* p2,
+                     const uint8_t* p3,
+                     uint8_t* out, const size_t n)
+{
+  size_t i = 0;
+
+#ifdef PSD_SSE2
+  for (; i+4 <= n; i += 4, out += 64) {
+    const __m128i a = _mm_loadu_si128((const __m128i*)(p0+4*i));
+    const __m128i b = _mm_loadu_si128((const __m128i*)(p1+4*i));
+    const __m128i c = _mm_loadu_si128((const __m128i*)(p2+4*i));
+    const __m128i d = _mm_loadu_si128((const __m128i*)(p3+4*i));
+    const __m128i abLo = _mm_unpacklo_epi32(a, b);
+    const __m128i abHi = _mm_unpackhi_epi32(a, b);
+    const __m128i cdLo = _mm_unpacklo_epi32(c, d);
+    const __m128i cdHi = _mm_unpackhi_epi32(c, d);
+    _mm_storeu_si128((__m128i*)(out   ), _mm_unpacklo_epi64(abLo, cdLo));
+    _mm_storeu_si128((__m128i*)(out+16), _mm_unpackhi_epi64(abLo, cdLo));
+    _mm_storeu_si128((__m128i*)(out+32), _mm_unpacklo_epi64(abHi, cdHi));
+    _mm_storeu_si128((__m128i*)(out+48), _mm_unpackhi_epi64(abHi, cdHi));
+  }
+#endif
+
+  for (; i<n; ++i, out += 16) {
+    for (int k=0; k<4; ++k) {
+      out[k] = p0[4*i+k];
+      out[4+k] = p1[4*i+k];
+      out[8+k] = p2[4*i+k];
+      out[12+k] = p3[4*i+k];
+    }
+  }
+}
+
+} // namespace psd
@@ -19,14 +19,22 @@ bool StdioFileInterface::ok() const
   return m_ok;
 }
 
-size_t StdioFileInterface::tell()
+uint64_t StdioFileInterface::tell()
 {
-  return ftell(m_file);
+#ifdef _WIN32
+  return _ftelli64(m_file);
+#else
+  return ftello(m_file);
+#endif
 }
 
-void StdioFileInterface::seek(size_t absPos)
+void StdioFileInterface::seek(uint64_t absPos)
 {
-  fseek(m_file, absPos, SEEK_SET);
+#ifdef _WIN32
+  _fseeki64(m_file, int64_t(absPos), SEEK_SET);
+#else
+  fseeko(m_file, off_t(absPos), SEEK_SET);
+#endif
 }
 
 uint8_t StdioFileInterface::read8()
@@ -44,6 +52,11 @@ bool StdioFileInterface::read(uint8_t* buf, uint32_t size)
   return (fread(buf, 1, size, m_file) == size);
 }
 
+size_t StdioFileInterface::readSome(uint8_t* buf, size_t size)
+{
+  return fread(buf, 1, size, m_file);
+}
+
 void StdioFileInterface::write8(uint8_t value)
 {
   fputc(value, m_file);
@@ -0,0 +1,179 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "test_psd.h"
+
+#include <map>
+#include <utility>
+
+using namespace psd;
+
+// Skips the "hidden" layer and the user mask and green channels of
+// all layers, and keeps the scanlines of the decoded channels
+class Delegate : public DecoderDelegate {
+public:
+  typedef std::pair<std::string, int> Key; // Layer name + channel ID
+  std::map<Key, std::vector<std::vector<uint8_t>>> rows;
+  std::vector<std::string> layers;
+
+  bool decodeLayer(const LayerRecord& layer) override {
+    return (layer.name != "hidden");
+  }
+  bool decodeChannel(const LayerRecord& layer,
+                     const Channel& channel) override {
+    return (channel.channelID != ChannelID::UserSuppliedMask &&
+            channel.channelID != ChannelID::Green);
+  }
+
+  void onBeginLayer(const LayerRecord& layer) override {
+    m_layer = layer.name;
+    layers.push_back(layer.name);
+  }
+  void onEndLayer(const LayerRecord& layer) override {
+    m_layer.clear();
+  }
+  void onImageScanline(const ImageData& img,
+                       const int y,
+                       const ChannelID chanID,
+                       const uint8_t* data,
+                       const int bytes) override {
+    if (!m_layer.empty())
+      rows[Key(m_layer, int(chanID))].emplace_back(data, data+bytes);
+  }
+
+private:
+  std::string m_layer;
+};
+
+// Keeps the interleaved rows of each layer, the channels that the
+// decoder asks to decode, and the planar scanlines (which shouldn't
+// be given when all layer channels can be interleaved)
+class InterleavedDelegate : public DecoderDelegate {
+public:
+  typedef std::pair<std::string, int> Key; // Layer name + channel ID
+  std::map<std::string, std::vector<std::vector<uint8_t>>> rows;
+  std::vector<Key> decodedChannels;
+  std::vector<Key> planarChannels;
+
+  bool decodeChannel(const LayerRecord& layer,
+                     const Channel& channel) override {
+    decodedChannels.push_back(Key(layer.name, int(channel.channelID)));
+    return true;
+  }
+
+  void onBeginLayer(const LayerRecord& layer) override {
+    m_layer = layer.name;
+  }
+  void onEndLayer(const LayerRecord& layer) override {
+    m_layer.clear();
+  }
+  void onImageScanline(const ImageData& img,
+                       const int y,
+                       const ChannelID chanID,
+                       const uint8_t* data,
+                       const int bytes) override {
+    if (!m_layer.empty())
+      planarChannels.push_back(Key(m_layer, int(chanID)));
+  }
+  void onInterleavedScanline(const ImageData& img,
+                             const int y,
+                             const uint8_t* data,
+                             const int bytes) override {
+    if (!m_layer.empty())
+      rows[m_layer].emplace_back(data, data+bytes);
+  }
+
+private:
+  std::string m_layer;
+};
+
+static std::vector<uint8_t> make_doc()
+{
+  const int w = 32, h = 24;
+  std::vector<test::Layer> layers;
+  const char* names[] = { "a", "hidden", "b" };
+  for (int i=0; i<3; ++i) {
+    const int lw = w - i*4, lh = h - i*3;
+    test::Layer layer = { names[i], i, i*2, i+lh, i*2+lw, { } };
+    const ChannelID ids[] = { ChannelID::TransparencyMask,
+                              ChannelID::Red,
+                              ChannelID::Green,
+                              ChannelID::Blue,
+                              ChannelID::UserSuppliedMask };
+    for (int j=0; j<5; ++j) {
+      const auto pixels = test::make_pixels(lw, lh, i*10+j);
+      layer.channels.push_back({ ids[j], test::raw_data(pixels) });
+    }
+    layers.push_back(layer);
+  }
+  return test::make_psd(w, h, layers, {
+      test::make_pixels(w, h, 100),
+      test::make_pixels(w, h, 101),
+      test::make_pixels(w, h, 102) });
+}
+
+int main()
+{
+  const std::vector<uint8_t> data = make_doc();
+
+  Delegate expected;
+  {
+    MemoryFileInterface file(data.data(), data.size());
+    EXPECT_TRUE(decode_psd(&file, &expected));
+  }
+
+  // Only the selected channels are decoded
+  EXPECT_EQ(expected.layers.size(), size_t(3));
+  EXPECT_EQ(expected.rows.size(), size_t(2*3));
+  for (const auto& it : expected.rows) {
+    EXPECT_TRUE(it.first.first != "hidden");
+    EXPECT_TRUE(it.first.second != int(ChannelID::Green));
+    EXPECT_TRUE(it.first.second != int(ChannelID::UserSuppliedMask));
+  }
+
+  // Document gives the same layers/channels/rows
+  MemoryFileInterface file(data.data(), data.size());
+  Document doc(&file);
+  EXPECT_TRUE(doc.load());
+  EXPECT_EQ(doc.layers().size(), size_t(3));
+
+  Delegate delegate;
+  for (size_t i=0; i<doc.layers().size(); ++i)
+    EXPECT_TRUE(doc.decodeLayer(i, &delegate));
+  EXPECT_TRUE(delegate.layers == expected.layers);
+  EXPECT_TRUE(delegate.rows == expected.rows);
+
+  // With interleaved pixels the masks are not decoded, and Document
+  // gives the same rows as decode_psd()
+  for (PixelLayout layout : { PixelLayout::RGBA, PixelLayout::BGRA }) {
+    DecoderOptions options;
+    options.pixelLayout = layout;
+
+    InterleavedDelegate expected;
+    {
+      MemoryFileInterface file(data.data(), data.size());
+      EXPECT_TRUE(decode_psd(&file, &expected, options));
+    }
+    EXPECT_EQ(expected.rows.size(), size_t(3));
+    EXPECT_EQ(expected.decodedChannels.size(), size_t(3*4));
+    for (const auto& key : expected.decodedChannels)
+      EXPECT_TRUE(key.second != int(ChannelID::UserSuppliedMask));
+    EXPECT_TRUE(expected.planarChannels.empty());
+
+    MemoryFileInterface file(data.data(), data.size());
+    Document doc(&file, options);
+    EXPECT_TRUE(doc.load());
+
+    InterleavedDelegate delegate;
+    for (size_t i=0; i<doc.layers().size(); ++i)
+      EXPECT_TRUE(doc.decodeLayer(i, &delegate));
+    EXPECT_TRUE(delegate.rows == expected.rows);
+    EXPECT_TRUE(delegate.decodedChannels == expected.decodedChannels);
+    EXPECT_TRUE(delegate.planarChannels == expected.planarChannels);
+  }
+
+  return 0;
+}
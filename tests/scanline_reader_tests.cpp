@@ -0,0 +1,63 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "test_psd.h"
+
+#include <cstring>
+
+using namespace psd;
+
+int main()
+{
+  const int w = 20, h = 10;
+  test::Layer layer = { "layer", 0, 0, h, w, { } };
+  for (int i=0; i<3; ++i)
+    layer.channels.push_back({ ChannelID(i),
+                               test::raw_data(test::make_pixels(w, h, i)) });
+  const std::vector<uint8_t> data = test::make_psd(w, h, { layer }, {
+      test::make_pixels(w, h, 3),
+      test::make_pixels(w, h, 4),
+      test::make_pixels(w, h, 5) });
+
+  MemoryFileInterface file(data.data(), data.size());
+  Document doc(&file);
+  EXPECT_TRUE(doc.load());
+  EXPECT_EQ(doc.layers().size(), size_t(1));
+
+  // All channels of the layer row by row
+  {
+    LayerReader reader(doc, 0);
+    EXPECT_TRUE(reader.ok());
+    EXPECT_EQ(reader.channels(), size_t(3));
+    EXPECT_EQ(reader.rows(), h);
+    int y = 0;
+    while (reader.nextRow()) {
+      for (int i=0; i<3; ++i) {
+        const auto pixels = test::make_pixels(w, h, i);
+        EXPECT_EQ(std::memcmp(reader.row(i), &pixels[y*w], w), 0);
+      }
+      ++y;
+    }
+    EXPECT_EQ(y, h);
+    EXPECT_TRUE(reader.ok());
+  }
+
+  // Invalid layer index
+  {
+    LayerReader reader(doc, 1);
+    EXPECT_FALSE(reader.ok());
+    EXPECT_EQ(reader.channels(), size_t(0));
+    EXPECT_TRUE(reader.layer().channels.empty());
+    EXPECT_EQ(reader.rows(), 0);
+    EXPECT_FALSE(reader.nextRow());
+
+    ScanlineReader channel(doc, 1, ChannelID::Red);
+    EXPECT_FALSE(channel.ok());
+    EXPECT_TRUE(channel.nextRow() == nullptr);
+  }
+
+  return 0;
+}
@@ -0,0 +1,188 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef PSD_TEST_PSD_H_INCLUDED
+#define PSD_TEST_PSD_H_INCLUDED
+#pragma once
+
+#include "psd.h"
+#include "psd_details.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#define EXPECT_TRUE(cond)                                 \
+  do {                                                    \
+    if (!(cond)) {                                        \
+      std::printf("%s:%d: failed: %s\n",                  \
+                  __FILE__, __LINE__, #cond);             \
+      std::exit(1);                                       \
+    }                                                     \
+  } while (0)
+
+#define EXPECT_FALSE(cond) EXPECT_TRUE(!(cond))
+#define EXPECT_EQ(a, b)    EXPECT_TRUE((a) == (b))
+
+namespace test {
+
+  // Channel of a layer: "data" contains the compression method
+  // followed by the image data (see raw_data() and zip_data()).
+  struct Channel {
+    psd::ChannelID id;
+    std::vector<uint8_t> data;
+  };
+
+  struct Layer {
+    std::string name;
+    int top, left, bottom, right;
+    std::vector<Channel> channels;
+  };
+
+  inline void put8(std::vector<uint8_t>& out, const uint32_t value) {
+    out.push_back(uint8_t(value));
+  }
+
+  inline void put16(std::vector<uint8_t>& out, const uint32_t value) {
+    out.push_back(uint8_t(value >> 8));
+    out.push_back(uint8_t(value));
+  }
+
+  inline void put32(std::vector<uint8_t>& out, const uint32_t value) {
+    put16(out, value >> 16);
+    put16(out, value);
+  }
+
+  inline void append(std::vector<uint8_t>& out,
+                     const std::vector<uint8_t>& data) {
+    out.insert(out.end(), data.begin(), data.end());
+  }
+
+  // Pixels of a channel with a different pattern for each "seed"
+  inline std::vector<uint8_t> make_pixels(const int width,
+                                          const int height,
+                                          const int seed) {
+    std::vector<uint8_t> pixels(size_t(width) * height);
+    for (size_t i=0; i<pixels.size(); ++i)
+      pixels[i] = uint8_t(i*7 + seed*31);
+    return pixels;
+  }
+
+  // Uncompressed channel data
+  inline std::vector<uint8_t> raw_data(const std::vector<uint8_t>& pixels) {
+    std::vector<uint8_t> out;
+    put16(out, uint16_t(psd::CompressionMethod::RawImageData));
+    append(out, pixels);
+    return out;
+  }
+
+  // ZIPWithoutPrediction channel data. The zlib stream is made of
+  // stored (not compressed) deflate blocks, so zlib isn't needed to
+  // create it.
+  inline std::vector<uint8_t> zip_data(const std::vector<uint8_t>& pixels) {
+    std::vector<uint8_t> out;
+    put16(out, uint16_t(psd::CompressionMethod::ZIPWithoutPrediction));
+    put8(out, 0x78);
+    put8(out, 0x01);
+    size_t i = 0;
+    do {
+      const size_t n = std::min<size_t>(pixels.size() - i, 0xffff);
+      put8(out, (i + n == pixels.size() ? 1: 0)); // Last block?
+      put8(out, n);
+      put8(out, n >> 8);
+      put8(out, ~n);
+      put8(out, ~n >> 8);
+      out.insert(out.end(), pixels.begin() + i, pixels.begin() + i + n);
+      i += n;
+    } while (i < pixels.size());
+
+    uint32_t a = 1, b = 0;        // Adler-32
+    for (uint8_t v : pixels) {
+      a = (a + v) % 65521;
+      b = (b + a) % 65521;
+    }
+    put32(out, (b << 16) | a);
+    return out;
+  }
+
+  // Creates an 8-bit RGB document with the given layers. The merged
+  // image contains "planes" (one for each RGB channel) without
+  // compression.
+  inline std::vector<uint8_t> make_psd(
+    const int width,
+    const int height,
+    const std::vector<Layer>& layers,
+    const std::vector<std::vector<uint8_t>>& planes) {
+    std::vector<uint8_t> out;
+
+    // File header
+    put32(out, PSD_FILE_MAGIC_NUMBER);
+    put16(out, 1);
+    put32(out, 0);
+    put16(out, 0);
+    put16(out, 3);
+    put32(out, height);
+    put32(out, width);
+    put16(out, 8);
+    put16(out, uint16_t(psd::ColorMode::RGB));
+
+    put32(out, 0);                // Color mode data
+    put32(out, 0);                // Image resources
+
+    // Layers info
+    std::vector<uint8_t> info;
+    put16(info, uint16_t(layers.size()));
+    for (const Layer& layer : layers) {
+      put32(info, layer.top);
+      put32(info, layer.left);
+      put32(info, layer.bottom);
+      put32(info, layer.right);
+      put16(info, uint16_t(layer.channels.size()));
+      for (const Channel& channel : layer.channels) {
+        put16(info, uint16_t(channel.id));
+        put32(info, uint32_t(channel.data.size()));
+      }
+      put32(info, PSD_BLEND_MODE_MAGIC_NUMBER);
+      put32(info, uint32_t(psd::LayerBlendMode::Normal));
+      put8(info, 255);            // Opacity
+      put8(info, 0);              // Clipping
+      put8(info, 0);              // Flags
+      put8(info, 0);              // Filler
+
+      // Pascal string padded to 4 bytes
+      std::vector<uint8_t> name;
+      put8(name, uint8_t(layer.name.size()));
+      name.insert(name.end(), layer.name.begin(), layer.name.end());
+      while (name.size() & 3)
+        put8(name, 0);
+
+      put32(info, uint32_t(8 + name.size()));
+      put32(info, 0);             // Mask data
+      put32(info, 0);             // Blending ranges
+      append(info, name);
+    }
+    for (const Layer& layer : layers)
+      for (const Channel& channel : layer.channels)
+        append(info, channel.data);
+
+    // Layers and mask section
+    put32(out, uint32_t(4 + info.size() + 4));
+    put32(out, uint32_t(info.size()));
+    append(out, info);
+    put32(out, 0);                // Global mask info
+
+    // Image data
+    put16(out, uint16_t(psd::CompressionMethod::RawImageData));
+    for (const auto& plane : planes)
+      append(out, plane);
+    return out;
+  }
+
+} // namespace test
+
+#endif
@@ -0,0 +1,111 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "test_psd.h"
+
+using namespace psd;
+
+// Keeps the scanlines of the red channel of the layer
+class Delegate : public DecoderDelegate {
+public:
+  std::vector<std::vector<uint8_t>> rows;
+
+  void onBeginLayer(const LayerRecord& layer) override { m_layer = true; }
+  void onEndLayer(const LayerRecord& layer) override { m_layer = false; }
+  void onImageScanline(const ImageData& img,
+                       const int y,
+                       const ChannelID chanID,
+                       const uint8_t* data,
+                       const int bytes) override {
+    if (m_layer && chanID == ChannelID::Red)
+      rows.emplace_back(data, data+bytes);
+  }
+
+private:
+  bool m_layer = false;
+};
+
+static std::vector<uint8_t> make_zip_psd(const std::vector<uint8_t>& zipData)
+{
+  const int w = 40, h = 30;
+  test::Layer layer = { "zip", 0, 0, h, w, { } };
+  layer.channels.push_back({ ChannelID::Red, zipData });
+  for (int i=1; i<3; ++i)
+    layer.channels.push_back({ ChannelID(i),
+                               test::raw_data(test::make_pixels(w, h, i)) });
+  return test::make_psd(w, h, { layer }, {
+      test::make_pixels(w, h, 3),
+      test::make_pixels(w, h, 4),
+      test::make_pixels(w, h, 5) });
+}
+
+static bool decode(const std::vector<uint8_t>& data, Delegate& delegate)
+{
+  MemoryFileInterface file(data.data(), data.size());
+  return decode_psd(&file, &delegate);
+}
+
+// Rows received before the error must be the real pixels (and not
+// zeros given as valid pixels)
+static void expect_valid_rows(const Delegate& delegate,
+                              const std::vector<uint8_t>& pixels,
+                              const int w)
+{
+  for (size_t y=0; y<delegate.rows.size(); ++y) {
+    const auto& row = delegate.rows[y];
+    EXPECT_EQ(row.size(), size_t(w));
+    EXPECT_TRUE(std::equal(row.begin(), row.end(), pixels.begin() + y*w));
+  }
+}
+
+int main()
+{
+  const int w = 40, h = 30;
+  const std::vector<uint8_t> pixels = test::make_pixels(w, h, 0);
+
+  // Complete ZIP data
+  {
+    Delegate delegate;
+    EXPECT_TRUE(decode(make_zip_psd(test::zip_data(pixels)), delegate));
+    EXPECT_EQ(delegate.rows.size(), size_t(h));
+    expect_valid_rows(delegate, pixels, w);
+  }
+
+  // The ZIP stream ends before the last scanline
+  {
+    const std::vector<uint8_t> half(pixels.begin(),
+                                    pixels.begin() + w*h/2 + 5);
+    Delegate delegate;
+    EXPECT_FALSE(decode(make_zip_psd(test::zip_data(half)), delegate));
+    EXPECT_TRUE(delegate.rows.size() < size_t(h));
+    expect_valid_rows(delegate, pixels, w);
+
+    // The same with a Document
+    const std::vector<uint8_t> data = make_zip_psd(test::zip_data(half));
+    MemoryFileInterface file(data.data(), data.size());
+    Document doc(&file);
+    EXPECT_TRUE(doc.load());
+    Delegate docDelegate;
+    EXPECT_FALSE(doc.decodeLayer(0, &docDelegate));
+    expect_valid_rows(docDelegate, pixels, w);
+  }
+
+  // The file ends in the middle of the ZIP data
+  {
+    std::vector<uint8_t> data = make_zip_psd(test::zip_data(pixels));
+    const size_t zipStart = data.size() - 3*w*h - 2  // Image data
+                                        - 4          // Global mask info
+                                        - 2*(2+w*h)  // Green/Blue
+                                        - (test::zip_data(pixels).size());
+    data.resize(zipStart + 2 + 2 + 5 + w*h/3);
+    Delegate delegate;
+    EXPECT_FALSE(decode(data, delegate));
+    EXPECT_TRUE(delegate.rows.size() < size_t(h));
+    expect_valid_rows(delegate, pixels, w);
+  }
+
+  return 0;
+}
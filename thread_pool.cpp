@@ -0,0 +1,105 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "psd_thread_pool.h"
+
+namespace psd {
+
+ThreadPool::ThreadPool(const int nthreads)
+  : m_fn(nullptr)
+  , m_n(0)
+  , m_next(0)
+  , m_pending(0)
+  , m_generation(0)
+  , m_stop(false)
+{
+  for (int i=1; i<nthreads; ++i)
+    m_workers.emplace_back([this]{ workerLoop(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_workCv.notify_all();
+  for (auto& worker : m_workers)
+    worker.join();
+}
+
+void ThreadPool::parallelFor(const size_t n,
+                             const std::function<void(size_t)>& fn)
+{
+  if (n == 0)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_fn = &fn;
+    m_n = n;
+    m_next = 0;
+    m_pending = m_workers.size();
+    m_error = nullptr;
+    ++m_generation;
+  }
+  m_workCv.notify_all();
+
+  // This thread works too
+  runTasks();
+
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCv.wait(lock, [this]{ return m_pending == 0; });
+    m_fn = nullptr;
+    std::swap(error, m_error);
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void ThreadPool::workerLoop()
+{
+  uint64_t generation = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_workCv.wait(lock, [this, generation]{
+        return m_stop || m_generation != generation;
+      });
+      if (m_stop)
+        return;
+      generation = m_generation;
+    }
+
+    runTasks();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (--m_pending == 0)
+      m_doneCv.notify_one();
+  }
+}
+
+void ThreadPool::runTasks()
+{
+  for (;;) {
+    const size_t i = m_next++;
+    if (i >= m_n)
+      break;
+
+    try {
+      (*m_fn)(i);
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_error)
+        m_error = std::current_exception();
+    }
+  }
+}
+
+} // namespace psd
@@ -0,0 +1,132 @@
+// Aseprite PSD Library
+// Copyright (C) 2021 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "psd_zip.h"
+
+#include "psd_simd.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#ifdef PSD_WITH_ZLIB
+  #include <zlib.h>
+#endif
+
+namespace psd {
+
+#ifdef PSD_WITH_ZLIB
+
+struct Inflater::Stream {
+  z_stream zstream;
+  bool end = false;
+};
+
+Inflater::Inflater()
+  : m_stream(new Stream)
+{
+  z_stream& zs = m_stream->zstream;
+  zs.zalloc = Z_NULL;
+  zs.zfree = Z_NULL;
+  zs.opaque = Z_NULL;
+  zs.next_in = Z_NULL;
+  zs.avail_in = 0;
+  if (inflateInit(&zs) != Z_OK)
+    throw std::runtime_error("Error initializing zlib");
+}
+
+Inflater::~Inflater()
+{
+  inflateEnd(&m_stream->zstream);
+}
+
+bool Inflater::inflate(const uint8_t*& in, size_t& inSize,
+                       uint8_t*& out, size_t& outSize)
+{
+  if (m_stream->end)
+    return false;
+
+  z_stream& zs = m_stream->zstream;
+  while (outSize > 0 && inSize > 0) {
+    // avail_in/out are 32-bit values
+    const uInt inChunk = uInt(inSize < 0x40000000 ? inSize: 0x40000000);
+    const uInt outChunk = uInt(outSize < 0x40000000 ? outSize: 0x40000000);
+    zs.next_in = (Bytef*)in;
+    zs.avail_in = inChunk;
+    zs.next_out = (Bytef*)out;
+    zs.avail_out = outChunk;
+
+    const int err = ::inflate(&zs, Z_NO_FLUSH);
+
+    in += inChunk - zs.avail_in;
+    inSize -= inChunk - zs.avail_in;
+    out += outChunk - zs.avail_out;
+    outSize -= outChunk - zs.avail_out;
+
+    if (err == Z_STREAM_END) {
+      m_stream->end = true;
+      return false;
+    }
+    if (err != Z_OK && err != Z_BUF_ERROR)
+      throw std::runtime_error("Invalid ZIP compressed data");
+    // No progress was possible
+    if (zs.avail_in == inChunk && zs.avail_out == outChunk)
+      break;
+  }
+  return true;
+}
+
+#else  // PSD_WITH_ZLIB
+
+struct Inflater::Stream { };
+
+Inflater::Inflater()
+{
+  throw std::runtime_error("ZIP compression is not supported (compiled without zlib)");
+}
+
+Inflater::~Inflater()
+{
+}
+
+bool Inflater::inflate(const uint8_t*& in, size_t& inSize,
+                       uint8_t*& out, size_t& outSize)
+{
+  return false;
+}
+
+#endif // PSD_WITH_ZLIB
+
+void undo_zip_prediction(uint8_t* row,
+                         const int width,
+                         const int depth,
+                         std::vector<uint8_t>& tmp)
+{
+  switch (depth) {
+    case 8:
+      prefix_sum_8(row, width);
+      break;
+    case 16:
+      prefix_sum_16be(row, width);
+      break;
+    case 32: {
+      // The bytes of 32-bit values are stored in 4 planes (first the
+      // high byte of each value, then the next byte, etc.) and the
+      // delta is applied to the whole sequence of bytes.
+      const size_t n = size_t(width)*4;
+      prefix_sum_8(row, n);
+      if (tmp.size() < n)
+        tmp.resize(n);
+      std::memcpy(&tmp[0], row, n);
+      interleave_4x8(&tmp[0],
+                     &tmp[width],
+                     &tmp[2*width],
+                     &tmp[3*width], row, width);
+      break;
+    }
+  }
+}
+
+} // namespace psd